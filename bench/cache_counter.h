@@ -0,0 +1,67 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Counts the L1 data cache read misses of the benchmarks with the
+// hardware counters of perf_event_open(2). Where they can not be used
+// (kernel.perf_event_paranoid, virtual machines) the counter is -1 and
+// the benchmarks print "n/a" instead.
+#pragma once
+#include <linux/perf_event.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+// Opens a stopped counter of the L1D read misses of the calling process
+// in user space, including the threads it starts later on. Returns -1 if
+// there is none.
+static inline int CacheMissCounter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Resets counter and starts it.
+static inline void StartCounter(int counter)
+{
+    if (counter == -1)
+        return;
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+// Stops counter and returns what it counted since StartCounter(), or -1.
+static inline long long StopCounter(int counter)
+{
+    if (counter == -1)
+        return -1;
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    long long count = 0;
+    if (read(counter, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return count;
+}
@@ -0,0 +1,171 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Times svn_status() end to end on a working copy and reports the
+// crawl speed, the L1 data cache misses and the peak memory use. -tN crawls on N threads, the
+// directories below the root and the externals at the same time, and
+// compares files on N threads for -n. -T trusts the timestamps instead
+// (--trust-timestamps). -u looks for unversioned items as well, as
+// svnwcrev does for $WCUNVER?...$.
+//
+// Usage: crawl_bench [-e] [-n] [-m] [-f] [-u] [-T] [-tN] [runs] WorkingCopyPath
+
+#include <apr_pools.h>
+#include <svn_client.h>
+#include <svn_dirent_uri.h>
+#include <svn_dso.h>
+#include <svn_wc.h>
+#include "../src/SVNWcRev.h"
+#include "cache_counter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+static svn_error_t * countnodes(void * baton, const char * /*path*/, const svn_wc_status3_t * /*status*/,
+                                apr_pool_t * /*pool*/)
+{
+    ++*(long *)baton;
+    return SVN_NO_ERROR;
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char ** argv)
+{
+    SubWCRev_t Options;
+    memset(&Options, 0, sizeof(Options));
+    Options.Threads = 1;
+    bool bErrOnMods = false;
+    bool bErrOnMixed = false;
+    bool bUnversioned = false;
+    int runs = 5;
+    const char * wc = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "-t", 2) == 0)
+            Options.Threads = atoi(argv[i] + 2);
+        else if (argv[i][0] == '-')
+        {
+            if (strchr(argv[i], 'e'))
+                Options.bExternals = true;
+            if (strchr(argv[i], 'f'))
+                Options.bFolders = true;
+            if (strchr(argv[i], 'n'))
+                bErrOnMods = true;
+            if (strchr(argv[i], 'm'))
+                bErrOnMixed = true;
+            if (strchr(argv[i], 'u'))
+                bUnversioned = true;
+            if (strchr(argv[i], 'T'))
+                Options.bTrustTimestamps = true;
+        }
+        else if ((wc == NULL) && (i + 1 < argc))
+            runs = atoi(argv[i]);
+        else
+            wc = argv[i];
+    }
+    if ((wc == NULL) || (runs <= 0) || (Options.Threads <= 0))
+    {
+        printf("Usage: crawl_bench [-e] [-n] [-m] [-f] [-u] [-T] [-tN] [runs] WorkingCopyPath\n");
+        return ERR_SYNTAX;
+    }
+    // what svnwcrev does for -n and -m without a template
+    Options.Skip = SKIP_NEEDS_LOCK | SKIP_IGNORED;
+    if (!bUnversioned)
+        Options.Skip |= SKIP_UNVERSIONED;
+    if (!bErrOnMods)
+        Options.Skip |= SKIP_TEXT_MODS;
+    else if (Options.bTrustTimestamps)
+        Options.Skip |= SKIP_TEXT_COMPARE;
+    Options.bStopOnMods = bErrOnMods;
+    Options.bStopOnMixed = bErrOnMixed && !bErrOnMods;
+
+    apr_initialize();
+    svn_dso_initialize2();
+    apr_pool_t * pool = NULL;
+    apr_pool_create(&pool, NULL);
+    svn_client_ctx_t * ctx = NULL;
+    svn_error_t * err = svn_client_create_context(&ctx, pool);
+
+    const char * abspath = NULL;
+    long nodes = 0;
+    if (err == NULL)
+        err = svn_dirent_get_absolute(&abspath, svn_dirent_internal_style(wc, pool), pool);
+    if (err == NULL)
+        err = svn_wc_walk_status(ctx->wc_ctx, abspath, svn_depth_infinity, TRUE, FALSE, TRUE, NULL,
+                                 countnodes, &nodes, NULL, NULL, pool);
+
+    double best = 0;
+    double total = 0;
+    long long misses = -1;  // of the best run
+    int counter = CacheMissCounter();
+    SubWCRev_t SubStat;
+    for (int run = 0; (err == NULL) && (run < runs); ++run)
+    {
+        apr_pool_t * runpool = NULL;
+        apr_pool_create(&runpool, pool);
+        memcpy(&SubStat, &Options, sizeof(SubWCRev_t));
+        double start = now();
+        StartCounter(counter);
+        err = svn_status(abspath, &SubStat, FALSE, ctx, runpool);
+        long long runmisses = StopCounter(counter);
+        double elapsed = now() - start;
+        apr_pool_destroy(runpool);
+        total += elapsed;
+        if ((run == 0) || (elapsed < best))
+        {
+            best = elapsed;
+            misses = runmisses;
+        }
+    }
+    if (counter != -1)
+        close(counter);
+    if (err)
+    {
+        svn_handle_error2(err, stderr, FALSE, "crawl_bench: ");
+        svn_error_clear(err);
+        apr_pool_destroy(pool);
+        apr_terminate2();
+        return ERR_SVN_ERR;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%s: %ld nodes (without externals), %d runs, %d threads\n", wc, nodes, runs, Options.Threads);
+    printf("  best %.3f s, mean %.3f s, %.0f nodes/s\n", best, total / runs, best > 0 ? nodes / best : 0.0);
+    printf("  revisions %ld:%ld, %s, %s, %s\n", (long)SubStat.MinRev, (long)SubStat.MaxRev,
+           SubStat.HasMods ? "modified" : "unmodified",
+           bUnversioned ? (SubStat.HasUnversioned ? "unversioned items" : "no unversioned items") : "unversioned items skipped",
+           SubStat.bStopped ? "stopped early" : "full crawl");
+    if ((misses >= 0) && (nodes > 0))
+        printf("  L1D read misses %.1f per node (best run)\n", (double)misses / nodes);
+    else
+        printf("  L1D read misses n/a\n");
+    printf("  peak RSS %ld KB\n", usage.ru_maxrss);
+
+    apr_pool_destroy(pool);
+    apr_terminate2();
+    return 0;
+}
@@ -0,0 +1,95 @@
+#!/bin/sh
+# Builds a synthetic working copy for the crawl benchmarks: a local
+# file:// repository filled with a tree of files, checked out, with
+# optional externals, local modifications and mixed revisions.
+#
+# Usage: bench/make_wc.sh DIR [nodes] [depth] [externals] [modified%] [mixed%]
+#
+#   nodes      number of files in the tree (default 1000)
+#   depth      directory nesting depth (default 3)
+#   externals  number of svn:externals on the working copy root (default 0)
+#   modified%  percentage of files with local modifications (default 0)
+#   mixed%     percentage of files updated to an older revision (default 0)
+#
+# The working copy is created in DIR/wc, the repository in DIR/repo.
+
+DIR=$1
+NODES=${2:-1000}
+DEPTH=${3:-3}
+EXTERNALS=${4:-0}
+MODIFIED=${5:-0}
+MIXED=${6:-0}
+
+if [ -z "$DIR" ]; then
+	echo "Usage: $0 DIR [nodes] [depth] [externals] [modified%] [mixed%]" >&2
+	exit 1
+fi
+mkdir -p "$DIR" || exit 1
+DIR=$(cd "$DIR" && pwd)
+rm -rf "$DIR/repo" "$DIR/wc" "$DIR/tree"
+
+# Spread the files evenly over the levels 0..DEPTH of a tree with ten
+# subdirectories per directory.
+mkdir -p "$DIR/tree/trunk" "$DIR/tree/ext"
+i=0
+while [ $i -lt "$NODES" ]; do
+	d="$DIR/tree/trunk"
+	level=$((i % (DEPTH + 1)))
+	n=$((i / (DEPTH + 1)))
+	while [ $level -gt 0 ]; do
+		d="$d/d$((n % 10))"
+		n=$((n / 10))
+		level=$((level - 1))
+	done
+	mkdir -p "$d"
+	echo "file $i" > "$d/file$i.txt"
+	i=$((i + 1))
+done
+i=0
+while [ $i -lt "$EXTERNALS" ]; do
+	mkdir -p "$DIR/tree/ext/ext$i"
+	j=0
+	while [ $j -lt 10 ]; do
+		echo "external $i file $j" > "$DIR/tree/ext/ext$i/file$j.txt"
+		j=$((j + 1))
+	done
+	i=$((i + 1))
+done
+
+svnadmin create "$DIR/repo" || exit 1
+svn import -q -m "bench tree" "$DIR/tree" "file://$DIR/repo" || exit 1
+rm -rf "$DIR/tree"
+svn checkout -q "file://$DIR/repo/trunk" "$DIR/wc" || exit 1
+
+if [ "$EXTERNALS" -gt 0 ]; then
+	i=0
+	: > "$DIR/externals"
+	while [ $i -lt "$EXTERNALS" ]; do
+		echo "^/ext/ext$i ext$i" >> "$DIR/externals"
+		i=$((i + 1))
+	done
+	svn propset -q svn:externals -F "$DIR/externals" "$DIR/wc" || exit 1
+	svn commit -q -m "bench externals" "$DIR/wc" || exit 1
+	rm -f "$DIR/externals"
+fi
+
+# Touch every file once more in a second revision, so that files can be
+# moved back to the revision before.
+if [ "$MIXED" -gt 0 ]; then
+	find "$DIR/wc" -name '*.txt' -path '*/file*' ! -path '*/.svn/*' ! -path '*/ext*' | while read -r f; do
+		echo "changed" >> "$f"
+	done
+	svn commit -q -m "bench second revision" "$DIR/wc" || exit 1
+fi
+svn update -q "$DIR/wc" || exit 1
+
+i=0
+find "$DIR/wc" -name 'file*.txt' ! -path '*/.svn/*' ! -path '*/ext*' | sort | while read -r f; do
+	if [ $((i % 100)) -lt "$MIXED" ]; then
+		svn update -q -r PREV "$f" || exit 1
+	fi
+	if [ $(((i * 37 + 11) % 100)) -lt "$MODIFIED" ]; then
+		echo "local change" >> "$f"
+	fi
+	i=$((i + 1))
+done
@@ -0,0 +1,74 @@
+#!/bin/sh
+# Runs the crawl benchmarks of "make bench" on a set of synthetic
+# working copies built by make_wc.sh.
+#
+# Usage: bench/run.sh [crawl_bench binary]
+#
+# Environment:
+#   BENCH_DIR    where the working copies are built (default: a temporary
+#                directory, removed afterwards)
+#   BENCH_NODES  files in the large working copies (default 10000)
+#   BENCH_RUNS   timed crawls per working copy (default 5)
+#   BENCH_THREADS  thread counts of the scaling runs (default 1 2 4 8 16 32)
+
+BENCH=${1:-bench/crawl_bench}
+NODES=${BENCH_NODES:-10000}
+RUNS=${BENCH_RUNS:-5}
+THREADS=${BENCH_THREADS:-1 2 4 8 16 32}
+SCRIPTS=$(dirname "$0")
+
+if [ -n "$BENCH_DIR" ]; then
+	WORK=$BENCH_DIR
+	mkdir -p "$WORK" || exit 1
+else
+	WORK=$(mktemp -d "${TMPDIR:-/tmp}/svnwcrev-bench.XXXXXX") || exit 1
+	trap 'rm -rf "$WORK"' EXIT
+fi
+
+# name nodes depth externals modified% mixed% crawl_bench-switches
+run()
+{
+	echo "== $1"
+	sh "$SCRIPTS/make_wc.sh" "$WORK/$1" "$2" "$3" "$4" "$5" "$6" > /dev/null || exit 1
+	"$BENCH" $7 "$RUNS" "$WORK/$1/wc" || exit 1
+}
+
+run small       1000     3 0 0  0  -
+run large       "$NODES" 4 0 0  0  -
+run deep        "$NODES" 8 0 0  0  -
+run modified    "$NODES" 4 0 5  0  -
+run modified-n  "$NODES" 4 0 5  0  -n
+run mixed       "$NODES" 4 0 0  10 -
+run mixed-m     "$NODES" 4 0 0  10 -m
+run externals   "$NODES" 4 8 0  0  -e
+
+# An unversioned build output directory inside the working copy: it is
+# read only when unversioned items are looked for ($WCUNVER?...$, -u).
+sh "$SCRIPTS/make_wc.sh" "$WORK/unversioned" "$NODES" 4 0 0 0 > /dev/null || exit 1
+mkdir -p "$WORK/unversioned/wc/build/obj" || exit 1
+(cd "$WORK/unversioned/wc/build/obj" && seq 1 "$((NODES * 4))" | sed 's/$/.o/' | xargs touch) || exit 1
+for u in - -u; do
+	echo "== unversioned $u"
+	"$BENCH" $u "$RUNS" "$WORK/unversioned/wc" || exit 1
+done
+
+# A working copy whose files were all touched, as by a fresh checkout or
+# a build step: -n has to compare every file with its pristine copy,
+# on more and more threads, unless the timestamps are trusted (-T).
+sh "$SCRIPTS/make_wc.sh" "$WORK/touched" "$NODES" 4 0 0 0 > /dev/null || exit 1
+find "$WORK/touched/wc" -name .svn -prune -o -type f -exec touch {} + || exit 1
+for t in $THREADS; do
+	echo "== touched -n -t$t"
+	"$BENCH" -n -t"$t" "$RUNS" "$WORK/touched/wc" || exit 1
+done
+echo "== touched -nT"
+"$BENCH" -nT "$RUNS" "$WORK/touched/wc" || exit 1
+
+# Scaling of the sharded crawl: the same working copy crawled on more and
+# more threads. The tree has ten directories below the root, so the crawl
+# is split ten ways at most; more threads cannot help it further.
+sh "$SCRIPTS/make_wc.sh" "$WORK/scaling" "$((NODES * 4))" 4 0 0 0 > /dev/null || exit 1
+for t in $THREADS; do
+	echo "== scaling -t$t"
+	"$BENCH" -t"$t" "$RUNS" "$WORK/scaling/wc" || exit 1
+done
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Times repeated svnwcrev runs on a tiny working copy, where the
+# per-crawl setup (opening wc.db, status editor) dominates the run time.
+#
+# Usage: bench/small_wc.sh [svnwcrev binary] [runs] [files]
+#
+# Compare two builds by running the script once with each binary.
+
+SVNWCREV=${1:-./svnwcrev}
+RUNS=${2:-200}
+FILES=${3:-10}
+
+case "$SVNWCREV" in
+	/*) ;;
+	*) SVNWCREV="$(pwd)/$SVNWCREV" ;;
+esac
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/svnwcrev-bench.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+svnadmin create "$WORK/repo" || exit 1
+svn checkout -q "file://$WORK/repo" "$WORK/wc" || exit 1
+i=0
+while [ $i -lt "$FILES" ]; do
+	echo "file $i" > "$WORK/wc/file$i.txt"
+	i=$((i + 1))
+done
+svn add -q "$WORK/wc"/file*.txt && svn commit -q -m "bench" "$WORK/wc" || exit 1
+svn update -q "$WORK/wc" || exit 1
+
+start=$(date +%s%N)
+i=0
+while [ $i -lt "$RUNS" ]; do
+	"$SVNWCREV" "$WORK/wc" > /dev/null || exit 1
+	i=$((i + 1))
+done
+end=$(date +%s%N)
+
+echo "$RUNS runs on $FILES files: $(( (end - start) / RUNS / 1000 )) us per run"
@@ -0,0 +1,196 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Microbenchmark for the status callback: feeds synthetic nodes to
+// getallstatus(), without a working copy, so the cost per node of
+// collecting the result can be seen apart from the cost of the walk.
+// Reports the time and the L1 data cache read misses per node for working
+// copies with no, some and only locked files, and for a crawl which looks
+// for the author of the working copy in every node. A second, untimed
+// pass over the first nodes counts the bytes of SubWCRev_t and of the
+// status baton whose value a node changes; writes of an unchanged value
+// and the lock strings the baton points to are not seen.
+//
+// Usage: status_bench [nodes]
+
+#include <apr_general.h>
+#include <apr_pools.h>
+#include <apr_time.h>
+#include <svn_wc.h>
+#include "../src/SVNWcRev.h"
+#include "cache_counter.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Nodes of the untimed pass which counts the bytes changed per node
+#define CHANGED_NODES 10000
+
+// Prepares SubStat and sb as svn_status() does, with what the root of the
+// working copy leaves for the other nodes.
+static void StartCrawl(SubWCRev_t * SubStat, SubWCRev_StatusBaton_t * sb, bool bNoAuthor,
+                       const svn_wc_status3_t * status, apr_pool_t * pool)
+{
+    memset(SubStat, 0, sizeof(SubWCRev_t));
+    SubStat->Skip = SKIP_ALL & ~SKIP_STATUS;
+    strcpy(SubStat->Url, "https://svn.example.com/repos/trunk");
+    if (!bNoAuthor)
+        strcpy(SubStat->Author, "author");
+    InitStatusBaton(sb, SubStat, pool);
+    sb->UrlRoot = status->repos_root_url;
+    sb->UrlRelpath = "trunk";
+}
+
+static size_t ChangedBytes(const void * before, const void * after, size_t len)
+{
+    const unsigned char * b = (const unsigned char *)before;
+    const unsigned char * a = (const unsigned char *)after;
+    size_t changed = 0;
+    for (size_t i = 0; i < len; ++i)
+        changed += (a[i] != b[i]);
+    return changed;
+}
+
+int main(int argc, char ** argv)
+{
+    long nodes = (argc > 1) ? atol(argv[1]) : 1000000;
+    if (nodes <= 0)
+    {
+        printf("Usage: status_bench [nodes]\n");
+        return ERR_SYNTAX;
+    }
+
+    apr_initialize();
+    apr_pool_t * pool = NULL;
+    apr_pool_create(&pool, NULL);
+
+    // A few different locks, as several users hold them in a real
+    // working copy.
+    std::string comment(200, 'c');
+    svn_lock_t locks[4];
+    char owners[4][16];
+    for (int i = 0; i < 4; ++i)
+    {
+        memset(&locks[i], 0, sizeof(svn_lock_t));
+        snprintf(owners[i], sizeof(owners[i]), "user%d", i);
+        locks[i].token = "opaquelocktoken:0";
+        locks[i].owner = owners[i];
+        locks[i].comment = comment.c_str();
+        locks[i].creation_date = apr_time_now();
+    }
+
+    svn_wc_status3_t status;
+    memset(&status, 0, sizeof(status));
+    status.kind = svn_node_file;
+    status.versioned = TRUE;
+    status.node_status = svn_wc_status_normal;
+    status.text_status = svn_wc_status_normal;
+    status.prop_status = svn_wc_status_none;
+    status.revision = 1000;
+    status.changed_rev = 900;
+    status.changed_date = apr_time_now();
+    status.changed_author = "author";
+    status.repos_root_url = "https://svn.example.com/repos";
+    status.repos_relpath = "trunk/src/file.c";
+
+    static const struct
+    {
+        const char * Name;
+        int LockedPercent;
+        bool bNoAuthor;     // the working copy root had no author
+    } Cases[] =
+    {
+        { "unlocked", 0, false },
+        { "locked-10%", 10, false },
+        { "locked-all", 100, false },
+        { "no-author", 0, true },
+    };
+
+    printf("SubWCRev_t: %zu bytes, %zu of them before the strings; status baton: %zu bytes\n",
+           sizeof(SubWCRev_t), offsetof(SubWCRev_t, Url), sizeof(SubWCRev_StatusBaton_t));
+    printf("%-12s %10s %10s %12s %12s\n", "case", "nodes", "ns/node", "misses/node", "changed B/node");
+    int counter = CacheMissCounter();
+    SubWCRev_t * SubStat = new SubWCRev_t;
+    SubWCRev_t * SubStatBefore = new SubWCRev_t;
+    for (size_t c = 0; c < sizeof(Cases) / sizeof(Cases[0]); ++c)
+    {
+        apr_pool_t * runpool = NULL;
+        apr_pool_create(&runpool, pool);
+        SubWCRev_StatusBaton_t sb;
+        StartCrawl(SubStat, &sb, Cases[c].bNoAuthor, &status, runpool);
+
+        double start = now();
+        StartCounter(counter);
+        for (long i = 0; i < nodes; ++i)
+        {
+            status.lock = ((i % 100) < Cases[c].LockedPercent) ? &locks[(i / 7) % 4] : NULL;
+            svn_error_t * err = getallstatus(&sb, "/wc/file.c", &status, pool);
+            if (err)
+                svn_error_clear(err);
+        }
+        FlushStatusBaton(&sb);
+        long long misses = StopCounter(counter);
+        double elapsed = now() - start;
+        apr_pool_destroy(runpool);
+
+        // the same nodes again, comparing the state before and after each
+        apr_pool_create(&runpool, pool);
+        SubWCRev_StatusBaton_t sbChanged;
+        StartCrawl(SubStat, &sbChanged, Cases[c].bNoAuthor, &status, runpool);
+        long changedNodes = (nodes < CHANGED_NODES) ? nodes : CHANGED_NODES;
+        unsigned char sbBefore[sizeof(SubWCRev_StatusBaton_t)];
+        unsigned long long changed = 0;
+        for (long i = 0; i < changedNodes; ++i)
+        {
+            status.lock = ((i % 100) < Cases[c].LockedPercent) ? &locks[(i / 7) % 4] : NULL;
+            memcpy(SubStatBefore, SubStat, sizeof(SubWCRev_t));
+            memcpy(sbBefore, (const void *)&sbChanged, sizeof(sbBefore));
+            svn_error_t * err = getallstatus(&sbChanged, "/wc/file.c", &status, pool);
+            if (err)
+                svn_error_clear(err);
+            changed += ChangedBytes(SubStatBefore, SubStat, sizeof(SubWCRev_t)) +
+                       ChangedBytes(sbBefore, &sbChanged, sizeof(sbBefore));
+        }
+        apr_pool_destroy(runpool);
+
+        char missesText[32] = "n/a";
+        if (misses >= 0)
+            snprintf(missesText, sizeof(missesText), "%.2f", (double)misses / nodes);
+        printf("%-12s %10ld %10.1f %12s %12.1f\n", Cases[c].Name, nodes, elapsed * 1e9 / nodes,
+               missesText, (double)changed / changedNodes);
+    }
+    if (counter != -1)
+        close(counter);
+    delete SubStatBefore;
+    delete SubStat;
+
+    apr_pool_destroy(pool);
+    apr_terminate2();
+    return 0;
+}
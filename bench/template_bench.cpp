@@ -0,0 +1,179 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Microbenchmarks for template expansion: TemplateFields() and
+// ExpandTemplate() over generated templates of 1 KB up to 100 MB, with
+// sparse and dense placeholders of every kind and with long values
+// (URLs, lock comments). Reports throughput and heap allocations.
+// Sizes whose output would exceed MAX_OUTPUT are left out.
+//
+// Usage: template_bench [max template size in KB]
+
+#include <apr_general.h>
+#include <apr_time.h>
+#include "../src/template.h"
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Count the heap allocations made while expanding.
+static size_t allocations = 0;
+
+void * operator new(size_t size)
+{
+    ++allocations;
+    void * p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+#define MAX_OUTPUT  ((size_t)1024 * 1024 * 1024)
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+typedef struct SubWcBenchCase_t
+{
+    const char * Name;
+    const char * Placeholder;
+} SubWcBenchCase_t;
+
+static const SubWcBenchCase_t Cases[] =
+{
+    { "revision",       "$WCREV$" },
+    { "range",          "$WCRANGE$" },
+    { "date",           "$WCDATE=%Y-%m-%d %H:%M:%S$" },
+    { "url",            "$WCURL$" },
+    { "boolean",        "$WCMODS?modified:unmodified$" },
+    { "lockcomment",    "$WCLOCKCOMMENT$" },
+    { "mixed",          "$WCREV$ $WCURL$ $WCMIXED?mixed:clean$ $WCLOCKOWNER$ $WCNOW$" },
+};
+
+// Build a template of about size bytes with a placeholder every spacing bytes.
+static void MakeTemplate(std::string & tmpl, size_t size, size_t spacing, const char * placeholder)
+{
+    tmpl.clear();
+    tmpl.reserve(size + spacing);
+    size_t len = strlen(placeholder);
+    while (tmpl.size() < size)
+    {
+        size_t filler = spacing > len ? spacing - len : 1;
+        for (size_t i = 0; i < filler; ++i)
+            tmpl += (i % 64 == 63) ? '\n' : (char)('a' + i % 26);
+        tmpl.append(placeholder, len);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    size_t maxsize = (argc > 1) ? (size_t)atol(argv[1]) * 1024 : 100 * 1024 * 1024;
+
+    apr_initialize();
+
+    // Values as long as svnwcrev allows them
+    SubWCRev_t * SubStat = new SubWCRev_t;
+    memset(SubStat, 0, sizeof(SubWCRev_t));
+    SubStat->MinRev = 1234;
+    SubStat->MaxRev = 98765;
+    SubStat->CmtRev = 98760;
+    SubStat->CmtDate = apr_time_now();
+    SubStat->HasMods = true;
+    SubStat->bIsSvnItem = true;
+    SubStat->LockData.IsLocked = true;
+    SubStat->LockData.CreationDate = apr_time_now();
+    strcpy(SubStat->Url, "https://svn.example.com/repos/project/");
+    memset(SubStat->Url + strlen(SubStat->Url), 'u', URL_BUF - 1 - strlen(SubStat->Url));
+    memset(SubStat->LockData.Owner, 'o', 64);
+    memset(SubStat->LockData.Comment, 'c', COMMENT_BUF - 1);
+
+    static const size_t Sizes[] = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 100 * 1024 * 1024 };
+    static const size_t Spacings[] = { 4096, 64 };
+
+    printf("%-12s %10s %8s %12s %12s %10s %12s\n",
+           "case", "size", "spacing", "fields MB/s", "expand MB/s", "out/in", "allocs/run");
+    std::string tmpl;
+    std::string output;
+    for (size_t c = 0; c < sizeof(Cases) / sizeof(Cases[0]); ++c)
+    {
+        // output/input of the previous size, to guess the next output size
+        double ratio[sizeof(Spacings) / sizeof(Spacings[0])] = { 1.0, 1.0 };
+        for (size_t s = 0; (s < sizeof(Sizes) / sizeof(Sizes[0])) && (Sizes[s] <= maxsize); ++s)
+        {
+            for (size_t p = 0; p < sizeof(Spacings) / sizeof(Spacings[0]); ++p)
+            {
+                if (Sizes[s] * ratio[p] > MAX_OUTPUT)
+                    continue;
+                MakeTemplate(tmpl, Sizes[s], Spacings[p], Cases[c].Placeholder);
+                double mb = tmpl.size() / (1024.0 * 1024.0);
+
+                // Repeat until a run takes long enough to be measured.
+                int runs = 0;
+                unsigned fields = 0;
+                double start = now();
+                double elapsed = 0;
+                do
+                {
+                    fields |= TemplateFields(tmpl.data(), tmpl.size());
+                    ++runs;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                double fieldsRate = mb * runs / elapsed;
+
+                runs = 0;
+                size_t allocs = 0;
+                start = now();
+                do
+                {
+                    std::string().swap(output);
+                    size_t before = allocations;
+                    ExpandTemplate(tmpl.data(), tmpl.size(), SubStat, output);
+                    allocs += allocations - before;
+                    ++runs;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+
+                ratio[p] = (double)output.size() / tmpl.size();
+                printf("%-12s %10zu %8zu %12.1f %12.1f %10.2f %12.1f\n", Cases[c].Name, tmpl.size(), Spacings[p],
+                       fieldsRate, mb * runs / elapsed, ratio[p], (double)allocs / runs);
+                fflush(stdout);
+                if (fields == 0)
+                    printf("%-12s placeholder not recognized!\n", Cases[c].Name);
+            }
+        }
+    }
+    delete SubStat;
+    apr_terminate2();
+    return 0;
+}
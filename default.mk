@@ -1,16 +1,38 @@
 %.d: %.cpp
 	$(CPP) -MM $(CPPFLAGS) -MT "$*.o $@ " $< > $@;
 
-.PHONY: all clean
+.PHONY: all clean bench
 
-all : $(EXECUTABLE_NAME)
+all : $(EXECUTABLE_NAME) libsvnwcrev.a libsvnwcrev.so
 
 clean : 
 	-rm -f $(objects) $(EXECUTABLE_NAME) $(objects:.o=.d)
+	-rm -f libsvnwcrev.a libsvnwcrev.so
+	-rm -f $(bench_objects) bench/crawl_bench bench/template_bench bench/status_bench
 
-$(EXECUTABLE_NAME) : $(objects)
+$(EXECUTABLE_NAME) : src/SVNWcRev.o src/daemon.o libsvnwcrev.a
 	$(CC) -o $@ $^ $(LDLIBS)
 
+libsvnwcrev.a : $(lib_objects)
+	$(AR) rcs $@ $^
+
+libsvnwcrev.so : $(lib_objects)
+	$(CC) -shared -o $@ $^ $(LDLIBS)
+
+bench/crawl_bench : bench/crawl_bench.o src/status.o src/stats.o src/wcdb.o
+	$(CC) -o $@ $^ $(LDLIBS)
+
+bench/template_bench : bench/template_bench.o src/template.o
+	$(CC) -o $@ $^ $(LDLIBS)
+
+bench/status_bench : bench/status_bench.o src/status.o src/stats.o src/wcdb.o
+	$(CC) -o $@ $^ $(LDLIBS)
+
+bench : bench/crawl_bench bench/template_bench bench/status_bench
+	sh bench/run.sh bench/crawl_bench
+	bench/template_bench
+	bench/status_bench
+
 $(objects): $(objects:.o=.d)
 
 include $(objects:.o=.d)
@@ -32,24 +32,22 @@
 // MOD: Replaced Windows specific includes with some UNIX specific includes
 // TODO: Try to use APR to achieve complete platform independence
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <svn_dso.h>
 #include "SVNWcRev.h"
+#include "libsvnwcrev.h"
+#include "template.h"
+#include "cache.h"
+#include "daemon.h"
+#include "stats.h"
 #include <stddef.h>
+#include <pthread.h>
 
 
-extern svn_error_t *svn_status (const char *path,
-                   void *status_baton,
-                   svn_boolean_t no_ignore,
-                   svn_client_ctx_t *ctx,
-                   apr_pool_t *pool);
- 
-
 // Define the help text as a multi-line macro
 // Every line except the last must be terminated with a backslash
 #define HelpText1 "\
-Usage: svnwcrev WorkingCopyPath [SrcVersionFile DstVersionFile] [-nmdf]\n\
+Usage: svnwcrev WorkingCopyPath [SrcVersionFile DstVersionFile] [-nmdfv]\n\
+       svnwcrev WorkingCopyPath --manifest=ManifestFile [-nmfexXv]\n\
+       svnwcrev --batch[=ListFile] [WorkingCopyPath...] [-nmfexXv]\n\
 \n\
 Params:\n\
 WorkingCopyPath    :   path to a Subversion working copy.\n\
@@ -74,7 +72,48 @@ DstVersionFile     :   path to save the resulting parsed file.\n\
 -x                 :   if given, then svnwcrev will write the revisions\n\
                        numbers in HEX instead of decimal\n\
 -X                 :   if given, then svnwcrev will write the revisions\n\
-                       numbers in HEX with '0x' before them\n"
+                       numbers in HEX with '0x' before them\n\
+-v                 :   if given, tell which parts of the working copy\n\
+                       status were collected and which were skipped\n\
+                       because the templates do not need them.\n\
+--manifest=FILE    :   read the working copy once and expand every template\n\
+                       listed in FILE. Each line of FILE holds\n\
+                       \"SrcVersionFile DstVersionFile [-dxX]\"; the switches\n\
+                       apply to that pair only, paths with blanks must be\n\
+                       quoted and lines starting with '#' are ignored.\n\
+--batch[=FILE]     :   print one line per working copy, for the working\n\
+                       copies given and those listed in FILE (one per line,\n\
+                       '-' for stdin): path, revision, range, mods, mixed,\n\
+                       exit code and URL, separated by tabs. The exit code\n\
+                       is that of the first working copy which failed.\n\
+--threads=N        :   crawl up to N directories below the working copy\n\
+                       root, externals (-e) or working copies (--batch)\n\
+                       at the same time, and compare up to N files whose\n\
+                       timestamps changed with their pristine copies.\n\
+                       Defaults to 1: the crawl runs on the calling\n\
+                       thread only.\n\
+--trust-timestamps :   take files whose size or timestamp changed since\n\
+                       the last svn command as modified, without comparing\n\
+                       them. Faster, but a file which was only touched\n\
+                       counts as a local modification.\n\
+--stats=json       :   write timings per phase, crawl counters and memory\n\
+                       high-water marks as JSON to stderr.\n\
+--trace=FILE       :   write a timeline of the run to FILE, to be loaded in\n\
+                       chrome://tracing or Perfetto.\n\
+--cache[=DIR]      :   remember the result in DIR (default ~/.cache/svnwcrev)\n\
+                       and reuse it while the working copy is unchanged.\n\
+                       Templates are compiled once and kept there as well.\n\
+--depfile=FILE     :   write a Make/Ninja depfile to FILE: DstVersionFile\n\
+                       depends on SrcVersionFile and the wc.db of the\n\
+                       working copy and its externals (-e), and on the\n\
+                       versioned files if $WCMODS?...$ is used. The build\n\
+                       can skip svnwcrev while none of them changed\n\
+                       (with Ninja, set restat = 1 on the rule).\n\
+--daemon[=SOCKET]  :   keep running and answer svnwcrev --connect on the Unix\n\
+                       socket SOCKET (default $XDG_RUNTIME_DIR/svnwcrev.sock).\n\
+                       Results are kept until the working copy changes.\n\
+--connect[=SOCKET] :   let the daemon on SOCKET do the work. Works without\n\
+                       a daemon as well, only slower. Not with --batch=-.\n"
 
 #define HelpText4 "\
 Switches must be given in a single argument, e.g. '-nm' not '-n -m'.\n\
@@ -109,268 +148,399 @@ $WCMODS$        True if local modifications found\n\
 $WCMIXED$       True if mixed update revisions found\n\
 $WCINSVN$       True if the item is versioned\n\
 $WCNEEDSLOCK$   True if the svn:needs-lock property is set\n\
-$WCISLOCKED$    True if the item is locked\n"
+$WCISLOCKED$    True if the item is locked\n\
+$WCUNVER$       True if unversioned items found\n"
 // End of multi-line help text.
 
 
-#define VERDEF           "$WCREV$"
-#define DATEDEF          "$WCDATE$"
-#define DATEDEFUTC       "$WCDATEUTC$"
-#define DATEWFMTDEF      "$WCDATE="
-#define DATEWFMTDEFUTC   "$WCDATEUTC="
-#define MODDEF           "$WCMODS?"
-#define RANGEDEF         "$WCRANGE$"
-#define MIXEDDEF         "$WCMIXED?"
-#define URLDEF           "$WCURL$"
-#define NOWDEF           "$WCNOW$"
-#define NOWDEFUTC        "$WCNOWUTC$"
-#define NOWWFMTDEF       "$WCNOW="
-#define NOWWFMTDEFUTC    "$WCNOWUTC="
-#define ISINSVN          "$WCINSVN?"
-#define NEEDSLOCK        "$WCNEEDSLOCK?"
-#define ISLOCKED         "$WCISLOCKED?"
-#define LOCKDATE         "$WCLOCKDATE$"
-#define LOCKDATEUTC      "$WCLOCKDATEUTC$"
-#define LOCKWFMTDEF      "$WCLOCKDATE="
-#define LOCKWFMTDEFUTC   "$WCLOCKDATEUTC="
-#define LOCKOWNER        "$WCLOCKOWNER$"
-#define LOCKCOMMENT      "$WCLOCKCOMMENT$"
-
-// Internal error codes
-#define ERR_SYNTAX		1	// Syntax error
-#define ERR_FNF			2	// File/folder not found
-#define ERR_OPEN		3	// File open error
-#define ERR_ALLOC		4	// Memory allocation error
-#define ERR_READ		5	// File read/write/size error
-#define ERR_SVN_ERR		6	// SVN error
-
-// Documented error codes
-#define ERR_SVN_MODS	7	// Local mods found (-n)
-#define ERR_SVN_MIXED	8	// Mixed rev WC found (-m)
-#define ERR_OUT_EXISTS	9	// Output file already exists (-d)
-#define ERR_NOWC       10   // the path is not a working copy or part of one
-
-// Value for apr_time_t to signify "now"
-#define USE_TIME_NOW    -2 // 0 and -1 might already be significant.
-
-
-
-int FindPlaceholder(char *def, char *pBuf, size_t & index, size_t filelength)
+
+
+// Where the messages and errors of the current run go, set by Run().
+// These are the client's when running as daemon, which serves several
+// requests at the same time, each on a thread of its own.
+static __thread FILE * msgout = NULL;
+static __thread FILE * errout = NULL;
+
+// Requests run side by side, except those which report the statistics:
+// these are per process, so they run alone.
+static pthread_rwlock_t RunLock = PTHREAD_RWLOCK_INITIALIZER;
+
+// path taken relative to cwd, the directory the command line was given
+// in, unless cwd is NULL or path is absolute or empty
+static std::string AbsolutePath(const char * cwd, const char * path)
 {
-	size_t deflen = strlen(def);
-	while (index + deflen <= filelength)
-	{
-		if (memcmp(pBuf + index, def, deflen) == 0)
-			return TRUE;
-		index++;
-	}
-	return FALSE;
+	if ((cwd == NULL) || (path[0] == '/') || (path[0] == 0))
+		return path;
+	return std::string(cwd) + "/" + path;
 }
 
-int InsertRevision(char * def, char * pBuf, size_t & index,
-					size_t & filelength, size_t maxlength,
-					long MinRev, long MaxRev, SubWCRev_t * SubStat)
+// One SrcVersionFile/DstVersionFile pair of a manifest.
+typedef struct SubWcManifestEntry_t
 {
-	// Search for first occurrence of def in the buffer, starting at index.
-	if (!FindPlaceholder(def, pBuf, index, filelength))
-	{
-		// No more matches found.
-		return FALSE;
-	}
-	// Format the text to insert at the placeholder
-	char destbuf[40];
-	if (MinRev == -1 || MinRev == MaxRev)
-	{
-	    if ((SubStat)&&(SubStat->bHexPlain))
-	      sprintf(destbuf, "%LX", (apr_int64_t)MaxRev);
-	    else if ((SubStat)&&(SubStat->bHexX))
-	      sprintf(destbuf, "%#LX", (apr_int64_t)MaxRev);
-	    else 
-	      sprintf(destbuf, "%Ld", (apr_int64_t)MaxRev);
+	std::string Src;
+	std::string Dst;
+	std::string SrcName;    // Src and Dst as written in the manifest, for the depfile
+	std::string DstName;
+	bool bSkipExisting;     // 'd': leave DstVersionFile alone if it exists
+	bool bHexPlain;         // 'x' or inherited from the command line
+	bool bHexX;             // 'X' or inherited from the command line
+} SubWcManifestEntry_t;
+
+// Split a manifest line into whitespace separated fields.
+// Fields containing blanks can be enclosed in double quotes.
+static void SplitManifestLine(const char * line, std::vector<std::string> & fields)
+{
+	const char * p = line;
+	for (;;)
+	{
+		while ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n'))
+			p++;
+		if ((*p == 0) || (*p == '#'))
+			return;
+		std::string field;
+		if (*p == '"')
+		{
+			p++;
+			while ((*p != 0) && (*p != '"'))
+				field += *p++;
+			if (*p == '"')
+				p++;
+		}
+		else
+		{
+			while ((*p != 0) && (*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n'))
+				field += *p++;
+		}
+		fields.push_back(field);
 	}
-	else
-	{
-	  if ((SubStat)&&(SubStat->bHexPlain))
-	    sprintf(destbuf, "%LX:%LX", (apr_int64_t)MinRev, (apr_int64_t)MaxRev);
-	  else if ((SubStat)&&(SubStat->bHexX))
-            sprintf(destbuf, "%#LX:%#LX", (apr_int64_t)MinRev, (apr_int64_t)MaxRev);
-	  else
-	    sprintf(destbuf, "%Ld:%Ld", (apr_int64_t)MinRev, (apr_int64_t)MaxRev);
-	}	
-	// Replace the $WCxxx$ string with the actual revision number
-	char * pBuild = pBuf + index;
-    ptrdiff_t Expansion = strlen(destbuf) - strlen(def);
-	if (Expansion < 0)
+}
+
+// Read the manifest file, one "SrcVersionFile DstVersionFile [-dxX]" per line.
+// Relative paths are relative to cwd.
+static int ReadManifest(const char * manifest, const char * cwd, const SubWCRev_t * SubStat,
+						std::vector<SubWcManifestEntry_t> & entries)
+{
+	FILE * fManifest = fopen(manifest, "r");
+	if (fManifest == NULL)
 	{
-		memmove(pBuild, pBuild - Expansion, filelength - ((pBuild - Expansion) - pBuf));
+		fprintf(msgout, "Unable to open manifest file '%s'\n", manifest);
+		return ERR_OPEN;
 	}
-	else if (Expansion > 0)
-	{
-		// Check for buffer overflow
-		if (maxlength < Expansion + filelength) return FALSE;
-		memmove(pBuild + Expansion, pBuild, filelength - (pBuild - pBuf));
+
+	int ret = 0;
+	char * line = NULL;
+	size_t linelen = 0;
+	int lineno = 0;
+	while ((ret == 0) && (getline(&line, &linelen, fManifest) != -1))
+	{
+		lineno++;
+		std::vector<std::string> fields;
+		SplitManifestLine(line, fields);
+		if (fields.empty())
+			continue;
+
+		SubWcManifestEntry_t entry;
+		entry.bSkipExisting = false;
+		entry.bHexPlain = SubStat->bHexPlain;
+		entry.bHexX = SubStat->bHexX;
+		if ((fields.size() < 2) || (fields.size() > 3) ||
+			((fields.size() == 3) && ((fields[2][0] != '-') || (fields[2].find_first_not_of("-dxX") != std::string::npos))))
+		{
+			fprintf(msgout, "Syntax error in manifest '%s' line %d\n", manifest, lineno);
+			ret = ERR_SYNTAX;
+			break;
+		}
+		entry.SrcName = fields[0];
+		entry.DstName = fields[1];
+		entry.Src = AbsolutePath(cwd, fields[0].c_str());
+		entry.Dst = AbsolutePath(cwd, fields[1].c_str());
+		if (fields.size() == 3)
+		{
+			const std::string & Params = fields[2];
+			if (Params.find('d') != std::string::npos)
+				entry.bSkipExisting = true;
+			if (Params.find_first_of("xX") != std::string::npos)
+			{
+				entry.bHexPlain = (Params.find('x') != std::string::npos);
+				entry.bHexX = (Params.find('X') != std::string::npos);
+			}
+		}
+		if (access(entry.Src.c_str(), R_OK) != 0)
+		{
+			fprintf(msgout, "File '%s' does not exist\n", entry.SrcName.c_str());
+			ret = ERR_FNF;
+			break;
+		}
+		entries.push_back(entry);
 	}
-	memmove(pBuild, destbuf, strlen(destbuf));
-	filelength += Expansion;
-	return TRUE;
+	free(line);
+	fclose(fManifest);
+	return ret;
 }
 
-int InsertDate(char * def, char * pBuf, size_t & index,
-				size_t & filelength, size_t maxlength,
-				apr_time_t date_svn)
-{ 
-	// Search for first occurrence of def in the buffer, starting at index.
-	if (!FindPlaceholder(def, pBuf, index, filelength))
+// Apply the switches given as "-nmfexXv" to SubStat and the checks.
+static void ParseSwitches(const char * Params, SubWCRev_t * SubStat,
+						  bool * pbErrOnMods, bool * pbErrOnMixed, bool * pbVerbose)
+{
+	if (strchr(Params, 'n') != 0)
+		*pbErrOnMods = TRUE;
+	if (strchr(Params, 'm') != 0)
+		*pbErrOnMixed = TRUE;
+	if (strchr(Params, 'v') != 0)
+		*pbVerbose = TRUE;
+	// the 'f' option is useful to keep the revision which is inserted in
+	// the file constant, even if there are commits on other branches.
+	// For example, if you tag your working copy, then half a year later
+	// do a fresh checkout of that tag, the folder in your working copy of
+	// that tag will get the HEAD revision of the time you check out (or
+	// do an update). The files alone however won't have their last-committed
+	// revision changed at all.
+	if (strchr(Params, 'f') != 0)
+		SubStat->bFolders = true;
+	if (strchr(Params, 'e') != 0)
+		SubStat->bExternals = true;
+	if (strchr(Params, 'x') != 0)
+		SubStat->bHexPlain = true;
+	if (strchr(Params, 'X') != 0)
+		SubStat->bHexX = true;
+}
+
+// Read the working copy paths of --batch=FILE, one per line. FILE "-"
+// is stdin.
+static int ReadBatchList(const char * list, std::vector<std::string> & paths)
+{
+	FILE * fList = (strcmp(list, "-") == 0) ? stdin : fopen(list, "r");
+	if (fList == NULL)
+	{
+		fprintf(msgout, "Unable to open list file '%s'\n", list);
+		return ERR_OPEN;
+	}
+	char * line = NULL;
+	size_t linelen = 0;
+	ssize_t len;
+	while ((len = getline(&line, &linelen, fList)) != -1)
 	{
-		// No more matches found.
-		return FALSE;
+		while ((len > 0) && ((line[len-1] == '\n') || (line[len-1] == '\r') || (line[len-1] == ' ') || (line[len-1] == '\t')))
+			line[--len] = 0;
+		if ((len == 0) || (line[0] == '#'))
+			continue;
+		paths.push_back(line);
 	}
-
- 	apr_time_exp_t newtime;
-	apr_status_t status = apr_time_exp_lt(&newtime, date_svn);
-	if(status)
-		return false;
-	
-	// Format the date/time in international format as yyyy/mm/dd hh:mm:ss
-	char destbuf[32];
-	sprintf(destbuf, "%04d/%02d/%02d %02d:%02d:%02d",
-			newtime.tm_year + 1900,
-			newtime.tm_mon + 1,
-			newtime.tm_mday,
-			newtime.tm_hour,
-			newtime.tm_min,
-			newtime.tm_sec);
-	// Replace the $WCDATE$ string with the actual commit date
-	char * pBuild = pBuf + index;
-	ptrdiff_t Expansion = strlen(destbuf) - strlen(def);
-	if (Expansion < 0)
-	{
-		memmove(pBuild, pBuild - Expansion, filelength - ((pBuild - Expansion) - pBuf));
-	}
-	else if (Expansion > 0)
-	{
-		// Check for buffer overflow
-		if (maxlength < Expansion + filelength) return FALSE;
-		memmove(pBuild + Expansion, pBuild, filelength - (pBuild - pBuf));
-	}
-	memmove(pBuild, destbuf, strlen(destbuf));
-	filelength += Expansion;
-	return TRUE;
+	free(line);
+	if (fList != stdin)
+		fclose(fList);
+	return 0;
 }
 
-int InsertUrl(char * def, char * pBuf, size_t & index,
-					size_t & filelength, size_t maxlength,
-					char * pUrl)
+// The columns of a --batch line after the path, formatted just like the
+// placeholders in templates. The exit code goes between mixed and URL.
+#define BATCH_COLUMNS   "$WCREV$\t$WCRANGE$\t$WCMODS?yes:no$\t$WCMIXED?yes:no$\t"
+#define BATCH_URL       "$WCURL$"
+
+// svnwcrev --batch[=FILE] [WorkingCopyPath...] [-nmfexXv]: the status of
+// many working copies at once, one line per working copy. Returns the
+// exit code of the first working copy which failed. Relative paths are
+// relative to cwd; the table shows them as given.
+static int RunBatch(int argc, char** argv, const char * cwd, const char * list, SubWCRev_t * Options,
+					SubWcContext * context)
 {
-	// Search for first occurrence of def in the buffer, starting at index.
-	if (!FindPlaceholder(def, pBuf, index, filelength))
+	bool bErrOnMods = FALSE;
+	bool bErrOnMixed = FALSE;
+	bool bVerbose = FALSE;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; ++i)
 	{
-		// No more matches found.
-		return FALSE;
+		if ((i == argc - 1) && (argv[i][0] == '-') && argv[i][1])
+			ParseSwitches(argv[i], Options, &bErrOnMods, &bErrOnMixed, &bVerbose);
+		else
+			paths.push_back(argv[i]);
 	}
-	// Replace the $WCURL$ string with the actual URL
-	char * pBuild = pBuf + index;
-	ptrdiff_t Expansion = strlen(pUrl) - strlen(def);
-	if (Expansion < 0)
+	if (list)
 	{
-		memmove(pBuild, pBuild - Expansion, filelength - ((pBuild - Expansion) - pBuf));
+		int ret = ReadBatchList(list, paths);
+		if (ret)
+			return ret;
 	}
-	else if (Expansion > 0)
+	if (paths.empty())
 	{
-		// Check for buffer overflow
-		if (maxlength < Expansion + filelength) return FALSE;
-		memmove(pBuild + Expansion, pBuild, filelength - (pBuild - pBuf));
+		fprintf(msgout, "No working copies given\n");
+		return ERR_SYNTAX;
 	}
-	memmove(pBuild, pUrl, strlen(pUrl));
-	filelength += Expansion;
-	return TRUE;
-}
 
-int InsertBoolean(char * def, char * pBuf, size_t & index, size_t & filelength, bool isTrue)
-{ 
-	// Search for first occurrence of def in the buffer, starting at index.
-	if (!FindPlaceholder(def, pBuf, index, filelength))
+	SubWcQuery_t query;
+	query.Fields = TemplateFields(BATCH_COLUMNS BATCH_URL, strlen(BATCH_COLUMNS BATCH_URL));
+	query.bErrOnMods = bErrOnMods;
+	query.bErrOnMixed = bErrOnMixed;
+	query.bComplete = true;		// the table shows revisions and mods whatever the exit code
+	query.CacheDir = NULL;
+
+	// --threads spreads over the working copies; the externals of
+	// each are crawled one after the other.
+	int threads = Options->Threads;
+	Options->Threads = 1;
+	std::vector<SubWcBatchItem_t> items(paths.size());
+	for (size_t i = 0; i < paths.size(); ++i)
 	{
-		// No more matches found.
-		return FALSE;
+		items[i].Path = AbsolutePath(cwd, paths[i].c_str());
+		memcpy(&items[i].SubStat, Options, sizeof(SubWCRev_t));
+		items[i].Err = NULL;
+		items[i].Info.Source = "";
 	}
-	// Look for the terminating '$' character
-	char * pBuild = pBuf + index;
-	char * pEnd = pBuild + 1;
-	while (*pEnd != '$')
+	std::vector<int> exitcodes(items.size(), 0);
+	for (size_t i = 0; i < items.size(); ++i)
 	{
-		pEnd++;
-		if (pEnd - pBuf >= (apr_int64_t)filelength)
-			return FALSE;	// No terminator - malformed so give up.
+		if (access(items[i].Path.c_str(), R_OK) != 0)
+			exitcodes[i] = ERR_FNF;
 	}
-	
-	// Look for the ':' dividing TrueText from FalseText
-	char *pSplit = pBuild + 1;
-	// This loop is guaranteed to terminate due to test above.
-	while (*pSplit != ':' && *pSplit != '$')
-		pSplit++;
-
-	if (*pSplit == '$')
-		return FALSE;		// No split - malformed so give up.
-
-	if (isTrue)
-	{
-		// Replace $WCxxx?TrueText:FalseText$ with TrueText
-		// Remove :FalseText$
-		memmove(pSplit, pEnd + 1, filelength - (pEnd + 1 - pBuf));
-		filelength -= (pEnd + 1 - pSplit);
-		// Remove $WCxxx?
-		size_t deflen = strlen(def);
-		memmove(pBuild, pBuild + deflen, filelength - (pBuild + deflen - pBuf));
-		filelength -= deflen;
-	}
-	else
+	context->GetStatusBatch(items, &query, threads);
+
+	int ret = 0;
+	fprintf(msgout, "# path\trevision\trange\tmods\tmixed\texit\turl\n");
+	for (size_t i = 0; i < items.size(); ++i)
 	{
-		// Replace $WCxxx?TrueText:FalseText$ with FalseText
-		// Remove terminating $
-		memmove(pEnd, pEnd + 1, filelength - (pEnd + 1 - pBuf));
-		filelength--;
-		// Remove $WCxxx?TrueText:
-		memmove(pBuild, pSplit + 1, filelength - (pSplit + 1 - pBuf));
-		filelength -= (pSplit + 1 - pBuild);
-	} // if (isTrue)
-	return TRUE;
+		SubWcBatchItem_t & item = items[i];
+		const SubWCRev_t * SubStat = &item.SubStat;
+		if (exitcodes[i] == ERR_FNF)
+		{
+			fprintf(errout, "svnwcrev : Directory or file '%s' does not exist\n", paths[i].c_str());
+			svn_error_clear(item.Err);
+			item.Err = NULL;
+		}
+		else if (item.Err)
+		{
+			exitcodes[i] = (item.Err->apr_err == SVN_ERR_WC_NOT_WORKING_COPY) ? ERR_NOWC : ERR_SVN_ERR;
+			svn_handle_error2(item.Err, errout, FALSE, "svnwcrev : ");
+			svn_error_clear(item.Err);
+		}
+		else if (bErrOnMods && SubStat->HasMods)
+			exitcodes[i] = ERR_SVN_MODS;
+		else if (bErrOnMixed && (SubStat->MinRev != SubStat->MaxRev))
+			exitcodes[i] = ERR_SVN_MIXED;
+		if (exitcodes[i] && !ret)
+			ret = exitcodes[i];
+
+		if ((exitcodes[i] == ERR_FNF) || (exitcodes[i] == ERR_NOWC) || (exitcodes[i] == ERR_SVN_ERR))
+		{
+			fprintf(msgout, "%s\t-\t-\t-\t-\t%d\t-\n", paths[i].c_str(), exitcodes[i]);
+			continue;
+		}
+		std::string columns;
+		std::string url;
+		ExpandTemplate(BATCH_COLUMNS, strlen(BATCH_COLUMNS), SubStat, columns);
+		ExpandTemplate(BATCH_URL, strlen(BATCH_URL), SubStat, url);
+		fprintf(msgout, "%s\t%s%d\t%s\n", paths[i].c_str(), columns.c_str(), exitcodes[i], url.c_str());
+		if (bVerbose)
+			fprintf(msgout, "# %s: status read from %s\n", paths[i].c_str(), item.Info.Source);
+	}
+	return ret;
 }
 
-int abort_on_pool_failure (int /*retcode*/)
+// Do the work for one command line. Relative paths are relative to cwd,
+// NULL for the current directory.
+static int RunCommand(int argc, char** argv, const char * cwd, SubWcContext * context,
+					  bool * pbStats, std::string * tracefile)
 {
-	abort ();
-	return -1;
-}
-
-
-
-int main(int argc, char** argv){
 	// we have three parameters
 	const char* src = NULL;
 	const char* dst = NULL;
 	const char* wc = NULL;
+	const char* manifest = NULL;
+	std::string manifestfile;
+	std::string cachedir;
+	std::string depfile;
+	bool bBatch = false;
+	const char* batchlist = NULL;
+	std::string batchfile;
 	bool bErrOnMods = FALSE;
 	bool bErrOnMixed = FALSE;
+	bool bVerbose = FALSE;
 	
 	SubWCRev_t SubStat;
 	memset (&SubStat, 0, sizeof (SubStat));
 	SubStat.bFolders = FALSE;
+	SubStat.Threads = 1;	// the parallel crawl is opt-in through --threads
 	
+	// Long options may be given anywhere; strip them before
+	// looking at the positional parameters.
+	int nArgs = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strncmp(argv[i], "--manifest=", 11) == 0)
+		{
+			manifestfile = AbsolutePath(cwd, argv[i] + 11);
+			manifest = manifestfile.c_str();
+		}
+		else if ((strcmp(argv[i], "--manifest") == 0) && (i + 1 < argc))
+		{
+			manifestfile = AbsolutePath(cwd, argv[++i]);
+			manifest = manifestfile.c_str();
+		}
+		else if (strncmp(argv[i], "--threads=", 10) == 0)
+			SubStat.Threads = atoi(argv[i] + 10);
+		else if (strcmp(argv[i], "--trust-timestamps") == 0)
+			SubStat.bTrustTimestamps = TRUE;
+		else if (strncmp(argv[i], "--cache=", 8) == 0)
+			cachedir = AbsolutePath(cwd, argv[i] + 8);
+		else if (strcmp(argv[i], "--cache") == 0)
+			cachedir = CacheDefaultDir();
+		else if ((strncmp(argv[i], "--depfile=", 10) == 0) && argv[i][10])
+			depfile = AbsolutePath(cwd, argv[i] + 10);
+		else if (strcmp(argv[i], "--batch") == 0)
+			bBatch = true;
+		else if ((strncmp(argv[i], "--batch=", 8) == 0) && argv[i][8])
+		{
+			// the daemon has no stdin of the client to read the list from
+			if ((cwd != NULL) && (strcmp(argv[i] + 8, "-") == 0))
+			{
+				fprintf(msgout, "--batch=- can not be used with --connect\n");
+				return ERR_SYNTAX;
+			}
+			bBatch = true;
+			batchfile = (strcmp(argv[i] + 8, "-") == 0) ? "-" : AbsolutePath(cwd, argv[i] + 8);
+			batchlist = batchfile.c_str();
+		}
+		else if (strcmp(argv[i], "--stats=json") == 0)
+			*pbStats = true;
+		else if ((strncmp(argv[i], "--trace=", 8) == 0) && argv[i][8])
+		{
+			*tracefile = AbsolutePath(cwd, argv[i] + 8);
+			Stats.bTrace = true;
+		}
+		else if (strncmp(argv[i], "--", 2) == 0)
+			argc = 0;	// unknown option - display help
+		else
+			argv[nArgs++] = argv[i];
+	}
+	if (argc)
+		argc = nArgs;
+	if (bBatch && manifest)
+		argc = 0;	// one or the other - display help
+	if (bBatch && argc)
+		return RunBatch(argc, argv, cwd, batchlist, &SubStat, context);
 
 	if (argc >= 2 && argc <= 5)
 	{
 		// WC path is always first argument.
 		wc = argv[1];
 	}
+	if (manifest && (argc > 3))
+	{
+		// templates come from the manifest only
+		wc = NULL;
+	}
+	// the paths as given are kept for the messages and the depfile
+	std::string srcfile;
+	std::string dstfile;
 	if (argc == 4 || argc == 5)
 	{
 		// SubWCRev Path Tmpl.in Tmpl.out [-params]
-		src = argv[2];
-		dst = argv[3];
-		if (access(src, R_OK) != 0)
+		srcfile = AbsolutePath(cwd, argv[2]);
+		dstfile = AbsolutePath(cwd, argv[3]);
+		src = srcfile.c_str();
+		dst = dstfile.c_str();
+		if ((wc != NULL) && (access(src, R_OK) != 0))
 		{
-			printf("File '%s' does not exist\n", src);
+			fprintf(msgout, "File '%s' does not exist\n", argv[2]);
 			return ERR_FNF;		// file does not exist
 		}
 	}
@@ -381,34 +551,15 @@ int main(int argc, char** argv){
 		const char* Params = argv[argc-1];
 		if (Params[0] == '-')
 		{
-			if (strchr(Params, 'n') != 0)
-				bErrOnMods = TRUE;
-			if (strchr(Params, 'm') != 0)
-				bErrOnMixed = TRUE;
+			ParseSwitches(Params, &SubStat, &bErrOnMods, &bErrOnMixed, &bVerbose);
 			if (strchr(Params, 'd') != 0)
 			{
 				if ((dst != NULL) && access(dst, W_OK) != 0)
 				{
-					printf("File '%s' already exists\n", dst);
+					fprintf(msgout, "File '%s' already exists\n", argv[3]);
 					return ERR_OUT_EXISTS;
 				}
 			}
-			// the 'f' option is useful to keep the revision which is inserted in
-			// the file constant, even if there are commits on other branches.
-			// For example, if you tag your working copy, then half a year later
-			// do a fresh checkout of that tag, the folder in your working copy of
-			// that tag will get the HEAD revision of the time you check out (or
-			// do an update). The files alone however won't have their last-committed
-			// revision changed at all.
-			if (strchr(Params, 'f') != 0)
-				SubStat.bFolders = true;
-			if (strchr(Params, 'e') != 0)
-				SubStat.bExternals = true;
-			if (strchr(Params, 'x') != 0)
-				SubStat.bHexPlain = true;
-			if (strchr(Params, 'X') != 0)
-			        SubStat.bHexX = true;
-			
 		}
 		else
 		{
@@ -416,157 +567,181 @@ int main(int argc, char** argv){
 			wc = NULL;
 		}
 	}
+	if (!depfile.empty() && (dst == NULL) && !manifest)
+	{
+		// no output to write a depfile for - display help
+		wc = NULL;
+	}
 	if (wc == NULL)
 	{
-		printf("SVNWCRev %s \n\n", SVNWCREV_VERSION);
-		puts(HelpText1);
-		puts(HelpText2);
- 		puts(HelpText3);
- 		puts(HelpText4);
- 		puts(HelpText5);
+		fprintf(msgout, "SVNWCRev %s \n\n", SVNWCREV_VERSION);
+		fprintf(msgout, "%s\n", HelpText1);
+		fprintf(msgout, "%s\n", HelpText2);
+		fprintf(msgout, "%s\n", HelpText3);
+		fprintf(msgout, "%s\n", HelpText4);
+		fprintf(msgout, "%s\n", HelpText5);
 		return ERR_SYNTAX;
 	}
 
-	char *fullpath = realpath (wc, NULL);
-	if (fullpath)
-		wc = fullpath;
+	// Read the manifest up front, so a bad manifest does not cost a crawl.
+	std::vector<SubWcManifestEntry_t> manifestEntries;
+	if (manifest)
+	{
+		int ret = ReadManifest(manifest, cwd, &SubStat, manifestEntries);
+		if (ret)
+			return ret;
+	}
+
+	std::string wcarg = AbsolutePath(cwd, wc);
+	char *fullpath = realpath (wcarg.c_str(), NULL);
+	std::string wcpath = fullpath ? fullpath : wcarg;
+	free (fullpath);
+	wc = wcpath.c_str();
 
 	if (access(wc, R_OK) != 0)
 	{
-		printf("Directory or file '%s' does not exist\n", wc);
-		free (fullpath);
+		fprintf(msgout, "Directory or file '%s' does not exist\n", wc);
 		return ERR_FNF;			// dir does not exist
 	}
-	char * pBuf = NULL;
-	size_t readlength = 0;
-	size_t filelength = 0;
-	size_t maxlength  = 0;
-	int hFile = -1;
-	struct stat inputStatus;
+
+	SubWcQuery_t query;
+	query.Fields = ~(WCF_MASK(WCF_UNVER) | WCF_LAST_NODE);	// the fields the templates need; the summary shows neither
+	query.bErrOnMods = bErrOnMods;
+	query.bErrOnMixed = bErrOnMixed;
+	query.bComplete = false;	// a failed check exits before anything is shown
+	query.CacheDir = cachedir.empty() ? NULL : cachedir.c_str();
+	// Every template is mapped once, here: its fields decide what the crawl
+	// collects. While the crawl runs, the prefetch reads wc.db ahead,
+	// compiles the templates and has the outputs read ahead.
+	std::vector<SubWcOutput_t> outputs;
 	if (dst != NULL)
 	{
-		// open the file and read the contents
-		hFile = open(src, O_RDONLY);
-		if (hFile == -1)
-		{
-			printf("Unable to open input file '%s'\n", src);
-			return ERR_OPEN;		// error opening file
-		}
-		
-		
-		if(fstat(hFile, &inputStatus) != 0){
-		}
-		
-		
-		filelength = inputStatus.st_size;
-		
-		if (filelength == 0)
-		{
-			printf("Could not determine filesize of '%s'\n", src);
-			return ERR_READ;
-		}
-		maxlength = filelength+4096;	// We might be increasing filesize.
-		pBuf = new char[maxlength];
-		if (pBuf == NULL)
-		{
-			printf("Could not allocate enough memory!\n");
-			return ERR_ALLOC;
-		}
-		if ((readlength = read(hFile, pBuf, filelength)) <= 0)
-		{
-			printf("Could not read the file '%s'\n", src);
-			return ERR_READ;
-		}
-		if (readlength != filelength)
+		outputs.resize(1);
+		outputs[0].Src = src;
+		outputs[0].Dst = dst;
+		query.Fields = 0;
+		int ret = context->LoadTemplate(&outputs[0], &query.Fields, msgout);
+		if (ret)
+			return ret;
+	}
+	else if (manifest)
+	{
+		outputs.resize(manifestEntries.size());
+		query.Fields = 0;
+		for (size_t i = 0; i < manifestEntries.size(); ++i)
 		{
-			printf("Could not read the file '%s' to the end!\n", src);
-			return ERR_READ;
+			outputs[i].Src = manifestEntries[i].Src;
+			outputs[i].Dst = manifestEntries[i].Dst;
+			// a template which cannot be read fails its own pair only
+			if (context->LoadTemplate(&outputs[i], &query.Fields, msgout) != 0)
+				query.Fields = ~0u;
 		}
-		close(hFile);
-
 	}
-
-
+	SubWcPrefetch prefetch(wc, SubStat.bExternals || SubStat.bExternalsNoMixedRevision, outputs, query.CacheDir);
 	// Now check the status of every file in the working copy
 	// and gather revision status information in SubStat.
-
-	apr_pool_t * pool;
-	svn_error_t * svnerr = NULL;
-	svn_client_ctx_t* ctx;
-	const char * internalpath;	
-
-	apr_initialize();
-	svn_dso_initialize2();
-	apr_pool_create_ex(&pool, NULL, abort_on_pool_failure, NULL);
-	svn_client_create_context(&ctx, pool);
-
-	if (getenv ("SVN_ASP_DOT_NET_HACK"))
-	{
-		svn_wc_set_adm_dir ("_svn", pool);
+	SubWcQueryInfo_t info;
+	info.Skip = 0;
+	svn_error_t * svnerr = context->GetStatus(wc, &query, &SubStat, &info);
+	if (!cachedir.empty())
+	{
+		fprintf(msgout, info.bCacheHit ? "Status cache hit\n" : "Status cache miss\n");
+	}
+	if (bVerbose)
+	{
+		unsigned skip = info.Skip;
+		fprintf(msgout, "Status read from %s\n", info.Source);
+		fprintf(msgout, "Lock information %s\n", (skip & SKIP_STATUS) ? "skipped" : "collected");
+		fprintf(msgout, "Text modifications %s\n", (skip & SKIP_TEXT_MODS) ? "skipped" :
+		        (skip & SKIP_TEXT_COMPARE) ? "collected from timestamps" : "collected");
+		fprintf(msgout, "Unversioned items %s\n", (skip & SKIP_UNVERSIONED) ? "skipped" : "collected");
+		fprintf(msgout, "Ignored items %s\n", (skip & SKIP_IGNORED) ? "skipped" : "collected");
+		fprintf(msgout, "svn:needs-lock %s\n", (skip & SKIP_NEEDS_LOCK) ? "skipped" : "collected");
+		fprintf(msgout, "svn:externals %s\n", SubStat.bExternals ? "collected" : "skipped");
+		// Without -n the crawl looks only for what the templates need.
+		if (skip & SKIP_STATUS)
+			fprintf(msgout, "Local modifications not checked\n");
+		if (SubStat.bStopped)
+			fprintf(msgout, "Crawl stopped early, the outcome of -n/-m was known\n");
 	}
-
-	const char* utf8Path = new char[MAX_PATH];
- 	svn_utf_cstring_to_utf8(&utf8Path, wc, pool);
-	free (fullpath);
-	internalpath = svn_dirent_internal_style (utf8Path, pool);
-
-	svnerr = svn_status(	internalpath,	//path
-							&SubStat,		//status_baton
-							TRUE,			//noignore
-							ctx,
-							pool);
 	if (svnerr){
-		svn_handle_error2(svnerr, stderr, FALSE, "svnwcrev : ");
+		svn_handle_error2(svnerr, errout, FALSE, "svnwcrev : ");
+		svn_error_clear(svnerr);
 	}
-	apr_pool_destroy(pool);
-	apr_terminate2();
 
 	if (bErrOnMods && SubStat.HasMods)
 	{
-		printf("Working copy has local modifications!\n");
+		fprintf(msgout, "Working copy has local modifications!\n");
 		return ERR_SVN_MODS;
 	}
 	
 	if (bErrOnMixed && (SubStat.MinRev != SubStat.MaxRev))
 	{
 	  if (SubStat.bHexPlain)
-	    printf("Working copy contains mixed revisions %LX:%LX!\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
+	    fprintf(msgout, "Working copy contains mixed revisions %LX:%LX!\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
 	  else if (SubStat.bHexX)
-            printf("Working copy contains mixed revisions %#LX:%#LX!\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
+            fprintf(msgout, "Working copy contains mixed revisions %#LX:%#LX!\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
 	  else
-	    printf("Working copy contains mixed revisions %Ld:%Ld!\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
+	    fprintf(msgout, "Working copy contains mixed revisions %Ld:%Ld!\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
 	  return ERR_SVN_MIXED;
 	}
 	
 	if (SubStat.bHexPlain)
-	  printf("Last committed at revision %LX\n", (long long int)SubStat.CmtRev);
+	  fprintf(msgout, "Last committed at revision %LX\n", (long long int)SubStat.CmtRev);
 	else if (SubStat.bHexX)
-	  printf ("Last committed at revision %#LX\n", (long long int)SubStat.CmtRev);
+	  fprintf(msgout, "Last committed at revision %#LX\n", (long long int)SubStat.CmtRev);
 	else
-	  printf("Last committed at revision %Ld\n", (long long int)SubStat.CmtRev);
+	  fprintf(msgout, "Last committed at revision %Ld\n", (long long int)SubStat.CmtRev);
 
 	if (SubStat.MinRev != SubStat.MaxRev)
 	{
 	  if (SubStat.bHexPlain)
-            printf("Mixed revision range %LX:%LX\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
+            fprintf(msgout, "Mixed revision range %LX:%LX\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
 	  else if (SubStat.bHexX)
-            printf("Mixed revision range %#LX:%#LX\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
+            fprintf(msgout, "Mixed revision range %#LX:%#LX\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
 	  else
-	    printf("Mixed revision range %Ld:%Ld\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
+	    fprintf(msgout, "Mixed revision range %Ld:%Ld\n", (long long int)SubStat.MinRev, (long long int)SubStat.MaxRev);
 	}
 	else
 	{
 	  if (SubStat.bHexPlain)
-            printf("Updated to revision %LX\n", (long long int)SubStat.MaxRev);
+            fprintf(msgout, "Updated to revision %LX\n", (long long int)SubStat.MaxRev);
 	  else if (SubStat.bHexX)
-            printf("Updated to revision %#LX\n", (long long int)SubStat.MaxRev);
+            fprintf(msgout, "Updated to revision %#LX\n", (long long int)SubStat.MaxRev);
 	  else
-	    printf("Updated to revision %Ld\n", (long long int)SubStat.MaxRev);
+	    fprintf(msgout, "Updated to revision %Ld\n", (long long int)SubStat.MaxRev);
 	}
 	
 	if (SubStat.HasMods)
 	{
-		printf("Local modifications found\n");
+		fprintf(msgout, "Local modifications found\n");
+	}
+
+	prefetch.Wait();
+	if (manifest)
+	{
+		// Every template of the manifest is expanded with the result of
+		// the one crawl above; a failing pair does not stop the others.
+		int ret = 0;
+		for (size_t i = 0; i < manifestEntries.size(); ++i)
+		{
+			const SubWcManifestEntry_t & entry = manifestEntries[i];
+			if (entry.bSkipExisting && (access(entry.Dst.c_str(), F_OK) == 0))
+				continue;
+			SubStat.bHexPlain = entry.bHexPlain;
+			SubStat.bHexX = entry.bHexX;
+			int pairret = context->ExpandOutput(&outputs[i], &SubStat, query.CacheDir, msgout);
+			if (pairret && !ret)
+				ret = pairret;
+		}
+		if ((ret == 0) && !depfile.empty())
+		{
+			std::vector<std::pair<std::string, std::string> > outputs;
+			for (std::vector<SubWcManifestEntry_t>::const_iterator I = manifestEntries.begin(); I != manifestEntries.end(); ++I)
+				outputs.push_back(std::make_pair(I->DstName, I->SrcName));
+			ret = context->WriteDepfile(depfile.c_str(), wc, &SubStat, query.Fields, outputs, msgout);
+		}
+		return ret;
 	}
 
 	if (dst == NULL)
@@ -574,140 +749,113 @@ int main(int argc, char** argv){
 		return 0;
 	}
 
-	// now parse the filecontents for version defines.
-	
-	size_t index = 0;
-	
-	while (InsertRevision((char *)VERDEF, pBuf, index, filelength, maxlength, -1, SubStat.CmtRev, &SubStat));
-	
-	index = 0;
-	while (InsertRevision((char *)RANGEDEF, pBuf, index, filelength, maxlength, SubStat.MinRev, SubStat.MaxRev, &SubStat));
-	
-	index = 0;
-	while (InsertDate((char *)DATEDEF, pBuf, index, filelength, maxlength, SubStat.CmtDate));
-	
-	index = 0;
-	while (InsertDate((char *)DATEDEFUTC, pBuf, index, filelength, maxlength, SubStat.CmtDate));
-
-	index = 0;
-	while (InsertDate((char *)DATEWFMTDEF, pBuf, index, filelength, maxlength, SubStat.CmtDate));
-	index = 0;
-	while (InsertDate((char *)DATEWFMTDEFUTC, pBuf, index, filelength, maxlength, SubStat.CmtDate));
-	
-	index = 0;
-	while (InsertDate((char *)NOWDEF, pBuf, index, filelength, maxlength, USE_TIME_NOW));
-
-	index = 0;
-	while (InsertDate((char *)NOWDEFUTC, pBuf, index, filelength, maxlength, USE_TIME_NOW));
-
-	index = 0;
-	while (InsertDate((char *)NOWWFMTDEF, pBuf, index, filelength, maxlength, USE_TIME_NOW));
-
-	index = 0;
-	while (InsertDate((char *)NOWWFMTDEFUTC, pBuf, index, filelength, maxlength, USE_TIME_NOW));
-	
-	index = 0;
-	while (InsertBoolean((char *)MODDEF, pBuf, index, filelength, SubStat.HasMods));
-	
-	index = 0;
-	while (InsertBoolean((char *)MIXEDDEF, pBuf, index, filelength, SubStat.MinRev != SubStat.MaxRev));
-	
-	
-	index = 0;
-	while (InsertUrl((char *)URLDEF, pBuf, index, filelength, maxlength, SubStat.Url));
-	
-	index = 0;
-	while (InsertBoolean((char *)ISINSVN, pBuf, index, filelength, SubStat.bIsSvnItem));
-
-	index = 0;
-	while (InsertBoolean((char *)NEEDSLOCK, pBuf, index, filelength, SubStat.LockData.NeedsLocks));
-	
-	index = 0;
-	while (InsertBoolean((char *)ISLOCKED, pBuf, index, filelength,  SubStat.LockData.IsLocked));
-
-	index = 0;
-	while (InsertDate((char *)LOCKDATE, pBuf, index, filelength, maxlength, SubStat.LockData.CreationDate));
-	
-	index = 0;
-	while (InsertDate((char *)LOCKDATEUTC, pBuf, index, filelength, maxlength, SubStat.LockData.CreationDate));
-	
-	index = 0;
-	while (InsertDate((char *)LOCKWFMTDEF, pBuf, index, filelength, maxlength, SubStat.LockData.CreationDate));
-	
-	index = 0;
-	while (InsertDate((char *)LOCKWFMTDEFUTC, pBuf, index, filelength, maxlength, SubStat.LockData.CreationDate));
-	
-	index = 0;
-	while (InsertUrl((char *)LOCKOWNER, pBuf, index, filelength, maxlength, SubStat.LockData.Owner));
-	
-	index = 0;
-	while (InsertUrl((char *)LOCKCOMMENT, pBuf, index, filelength, maxlength, SubStat.LockData.Comment));
-
-	
+	int ret = context->ExpandOutput(&outputs[0], &SubStat, query.CacheDir, msgout);
+	if ((ret == 0) && !depfile.empty())
+	{
+		std::vector<std::pair<std::string, std::string> > outputs(1, std::make_pair(std::string(argv[3]), std::string(argv[2])));
+		ret = context->WriteDepfile(depfile.c_str(), wc, &SubStat, query.Fields, outputs, msgout);
+	}
+	return ret;
+}
 
+// Run one command line given in cwd, writing messages to out and errors
+// to err. The daemon calls this once per request.
+static int Run(int argc, char** argv, const char * cwd, FILE * out, FILE * err, SubWcContext * context)
+{
+	msgout = out;
+	errout = err;
 
-	
-	hFile = open(dst, O_RDWR | O_CREAT);
-	if (hFile == -1)
+	bool bExclusive = false;
+	for (int i = 1; i < argc; ++i)
 	{
-		printf("Unable to open output file '%s' for writing\n", dst);
-		return ERR_OPEN;
+		if ((strcmp(argv[i], "--stats=json") == 0) || (strncmp(argv[i], "--trace=", 8) == 0))
+			bExclusive = true;
 	}
+	if (bExclusive)
+		pthread_rwlock_wrlock(&RunLock);
+	else
+		pthread_rwlock_rdlock(&RunLock);
 
-	struct stat status;
-	if(fstat(hFile, &status) != 0){
-		printf("Unable retrieve satus of output file '%s'\n", dst);
-		return ERR_OPEN;
+	StatsReset();
+	if (bExclusive)
+	{
+		Stats.PhaseNs[PHASE_INIT] = context->InitNs;
+		Stats.PhaseNs[PHASE_CONTEXT] = context->ContextNs;
 	}
-	
-	size_t filelengthExisting = status.st_size;
-
-	bool sameFileContent = false;
-	if (filelength == filelengthExisting)
+	bool bStats = false;
+	std::string tracefile;
+	apr_int64_t start = StatsNow();
+	int ret = RunCommand(argc, argv, cwd, context, &bStats, &tracefile);
+	if (bStats)
+		StatsWriteJson(errout);
+	if (!tracefile.empty())
 	{
-		size_t readlengthExisting = 0;
-		char * pBufExisting = new char[filelength];
-		if ((readlengthExisting = read(hFile, pBufExisting, filelengthExisting)) <= 0)
+		// the one time setup, unless done long ago by the daemon
+		if (context->InitNs)
 		{
-			printf("Could not read the file '%s'\n", dst);
-			return ERR_READ;
+			apr_int64_t init = context->StartNs + context->InitNs;
+			TraceSpan("init", "phase", context->StartNs, init, NULL);
+			TraceSpan("context", "phase", init, init + context->ContextNs, NULL);
 		}
-		if (readlengthExisting != filelengthExisting)
+		TraceSpan("svnwcrev", "run", start, StatsNow(), NULL);
+		if (!TraceWrite(tracefile.c_str()))
+			fprintf(errout, "svnwcrev : could not write trace file '%s'\n", tracefile.c_str());
+	}
+	pthread_rwlock_unlock(&RunLock);
+	return ret;
+}
+
+int main(int argc, char** argv){
+	// --daemon and --connect decide who does the work
+	std::string socketpath;
+	bool bDaemon = false;
+	bool bConnect = false;
+	int nArgs = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		if ((strcmp(argv[i], "--daemon") == 0) || (strncmp(argv[i], "--daemon=", 9) == 0))
 		{
-			printf("Could not read the file '%s' to the end!\n", dst);
-			return ERR_READ;
+			bDaemon = true;
+			socketpath = argv[i][8] ? argv[i] + 9 : "";
 		}
-		sameFileContent = (memcmp(pBuf, pBufExisting, filelength) == 0);
-		delete [] pBufExisting;
+		else if ((strcmp(argv[i], "--connect") == 0) || (strncmp(argv[i], "--connect=", 10) == 0))
+		{
+			bConnect = true;
+			socketpath = argv[i][9] ? argv[i] + 10 : "";
+		}
+		else
+			argv[nArgs++] = argv[i];
 	}
+	argc = nArgs;
+	argv[argc] = NULL;
+	if (socketpath.empty())
+		socketpath = DaemonDefaultSocket();
 
-	// The file is only written if its contents would change.
-	// This prevents the timestamp from changing.
-	if (!sameFileContent)
+	// The list on stdin would have to go to the daemon as well.
+	for (int i = 1; bConnect && (i < argc); ++i)
 	{
-		lseek(hFile, 0, SEEK_SET);
-
-		readlength = write(hFile, pBuf, filelength);
-		if (readlength != filelength)
+		if (strcmp(argv[i], "--batch=-") == 0)
 		{
-			printf("Could not write the file '%s' to the end!\n", dst);
-			return ERR_READ;
+			fprintf(stderr, "svnwcrev : --batch=- can not be used with --connect\n");
+			return ERR_SYNTAX;
 		}
+	}
 
-		if (ftruncate(hFile, filelength) != 0)
-		{
-			printf("Could not truncate the file '%s' to the end!\n", dst);
-			return ERR_READ;
-		}
-		
-		// HACK: set file modes to the same as the input file
-		// as open seems to ignore the umask setting (??)
-		// TODO: Why is this? --> Find better solution
-		fchmod(hFile, inputStatus.st_mode); 
-	}
-	close(hFile);
-	delete [] pBuf;
-	
-	return 0;
-}
+	// Without a daemon to talk to, just do the work ourselves.
+	int exitcode = 0;
+	if (bConnect && DaemonClient(socketpath.c_str(), argc, argv, &exitcode))
+		return exitcode;
 
+	// The daemon remembers the results between requests.
+	SubWcContext context(bDaemon);
+	if (bDaemon)
+	{
+		context.InitNs = 0;		// paid once, not per request
+		context.ContextNs = 0;
+		exitcode = DaemonServe(socketpath.c_str(), Run, &context);
+	}
+	else
+		exitcode = Run(argc, argv, NULL, stdout, stderr, &context);
+
+	return exitcode;
+}
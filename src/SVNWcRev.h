@@ -16,7 +16,8 @@
 // You should have received a copy of the GNU General Public License
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
-//#pragma once
+#pragma once
+#include <string>
 #include <vector>
 
 #include <apr_pools.h>
@@ -30,6 +31,29 @@
 #define COMMENT_BUF	4096
 #define MAX_PATH 512 // is this enough?
 
+// Internal error codes
+#define ERR_SYNTAX		1	// Syntax error
+#define ERR_FNF			2	// File/folder not found
+#define ERR_OPEN		3	// File open error
+#define ERR_ALLOC		4	// Memory allocation error
+#define ERR_READ		5	// File read/write/size error
+#define ERR_SVN_ERR		6	// SVN error
+
+// Documented error codes
+#define ERR_SVN_MODS	7	// Local mods found (-n)
+#define ERR_SVN_MIXED	8	// Mixed rev WC found (-m)
+#define ERR_OUT_EXISTS	9	// Output file already exists (-d)
+#define ERR_NOWC       10   // the path is not a working copy or part of one
+
+// The parts of the crawl which can be left out if nothing needs their result
+#define SKIP_TEXT_MODS      0x01    // do not compare file contents for HasMods
+#define SKIP_UNVERSIONED    0x02    // do not look for unversioned items
+#define SKIP_NEEDS_LOCK     0x04    // do not look up svn:needs-lock
+#define SKIP_STATUS         0x08    // no status crawl at all, revisions from wc.db only
+#define SKIP_TEXT_COMPARE   0x10    // files whose size or timestamp changed count as modified, unread
+#define SKIP_IGNORED        0x20    // do not report ignored items
+#define SKIP_ALL            0x3f
+
 /**
  * \ingroup SubWCRev
  * This structure is used as a part of the status baton for WC crawling
@@ -47,6 +71,9 @@ typedef struct SubWcLockData_t
 
 // This structure is used as the status baton for WC crawling
 // and contains all the information we are collecting.
+// The fields the crawl updates for every node come first, the options next,
+// and the big string buffers last, so a crawl keeps a few cache lines hot
+// instead of striding over the whole structure.
 typedef struct SubWCRev_t
 {
     svn_revnum_t MinRev;    // Lowest update revision found
@@ -55,19 +82,28 @@ typedef struct SubWCRev_t
     apr_time_t CmtDate;     // Date of highest commit revision
     bool HasMods;           // True if local modifications found
     bool HasUnversioned;    // True if unversioned items found
+    bool bIsSvnItem;           // True if the item is under SVN
+    bool  bItemSeen;   // True if a node of this crawl has set bIsSvnItem and LockData
+    bool  bStopped;    // True if the crawl stopped early; the other fields are incomplete then
+    bool  bIsExternalsNotFixed; // True if one external is not fixed to a specified revision
+    bool  bIsExternalMixed; // True if one external, which is fixed has not the explicit revsion set
+    bool  bIsTagged;   // True if working copy URL contains "tags" keyword
+    bool  bNeedsLockSeen; // True if LockData.NeedsLocks was read from the crawled item
     bool bFolders;          // If TRUE, status of folders is included
     bool bExternals;        // If TRUE, status of externals is included
     bool bExternalsNoMixedRevision; // If TRUE, externals set to an explicit revision lead not to an mixed revsion error
     bool bHexPlain;         // If TRUE, revision numbers are output in HEX
     bool bHexX;             // If TRUE, revision numbers are output in HEX with '0x'
+    bool  bStopOnMods; // If TRUE, the crawl stops at the first local modification (-n)
+    bool  bStopOnMixed; // If TRUE, the crawl stops as soon as mixed revisions are found (-m)
+    bool  bTrustTimestamps; // If TRUE, files are not compared with their pristine copies (SKIP_TEXT_COMPARE)
+    unsigned Skip;     // SKIP_xxx: the parts of the crawl which are left out
+    int   Threads;     // Number of threads used to crawl externals
+    int   Depth;       // 0 for the working copy, one more than the parent's for externals
     char Url[URL_BUF];      // URL of working copy
     char RootUrl[URL_BUF];  // url of the repository root
     char Author[URL_BUF];   // The author of the wcPath
-    bool bIsSvnItem;           // True if the item is under SVN
     SubWcLockData_t LockData;   // Data regarding the lock of the file
-    bool  bIsExternalsNotFixed; // True if one external is not fixed to a specified revision
-    bool  bIsExternalMixed; // True if one external, which is fixed has not the explicit revsion set
-    bool  bIsTagged;   // True if working copy URL contains "tags" keyword
 } SubWCRev_t;
 
 /**
@@ -81,6 +117,18 @@ typedef struct SubWcExtData_t
     svn_opt_revision_t Revision;  // What revision to check out.
 } SubWcExtData_t;
 
+/**
+ * \ingroup SubWCRev
+ * The partial result of crawling one external. Externals are crawled
+ * independently and then merged into the parent result in the order
+ * in which they were found.
+ */
+typedef struct SubWcExtResult_t
+{
+    SubWcExtData_t Ext;
+    SubWCRev_t SubStat;
+} SubWcExtResult_t;
+
 /**
  * \ingroup SubWCRev
  * Collects all the SubWCRev_t structures in an array.
@@ -89,10 +137,63 @@ typedef struct SubWCRev_StatusBaton_t
 {
     SubWCRev_t * SubStat;
     std::vector<SubWcExtData_t> * extarray;
-    apr_pool_t *pool;
+    apr_pool_t *pool;          // holds the paths of the externals found
     svn_wc_context_t * wc_ctx;
+    const char * RootPath;      // path the crawl started at
+    // repos_root_url and repos_relpath of the node SubStat->Url was made
+    // of, so nodes can be compared with it without unescaping them
+    const char * UrlRoot;
+    const char * UrlRelpath;
+    // The lock of the last node crawled. The strings are copied only when
+    // they differ from the previous lock, into buffers which are reused,
+    // and into SubStat->LockData once, by FlushStatusBaton().
+    bool bItemSeen;             // a node of this crawl set the lock
+    bool IsLocked;
+    apr_time_t LockDate;
+    std::string LockOwner;
+    std::string LockComment;
 } SubWCRev_StatusBaton_t;
 
+/**
+ * \ingroup SubWCRev
+ * Prepares sb for a crawl collecting into SubStat; the paths of the
+ * externals are kept in pool.
+ */
+void InitStatusBaton(SubWCRev_StatusBaton_t * sb, SubWCRev_t * SubStat, apr_pool_t * pool);
+
+/**
+ * \ingroup SubWCRev
+ * Copies what the crawl kept in sb into sb->SubStat. Must be called before
+ * the pool of sb is destroyed.
+ */
+void FlushStatusBaton(SubWCRev_StatusBaton_t * sb);
+
+/**
+ * \ingroup SubWCRev
+ * The svn_wc_walk_status() callback of svn_status(), collecting into the
+ * SubWCRev_StatusBaton_t baton.
+ */
+svn_error_t * getallstatus(void * baton, const char * path, const svn_wc_status3_t * status, apr_pool_t * pool);
+
+/**
+ * \ingroup SubWCRev
+ * Copy the URL made of root and src to dest, unescaping on the fly.
+ */
+void UnescapeCopy(const char * root, const char * src, char * dest, int buf_len);
+
+/**
+ * \ingroup SubWCRev
+ * Returns TRUE if the URL points to a tag.
+ */
+bool IsTaggedVersion(const char * url);
+
+/**
+ * \ingroup SubWCRev
+ * Has the kernel read the whole file at path ahead, in large requests,
+ * into the page cache. Does nothing if it cannot be opened.
+ */
+void PrefetchFile(const char * path);
+
 /**
  * \ingroup SubWCRev
  * Callback function when fetching the Subversion status
@@ -0,0 +1,327 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <apr_pools.h>
+#include "cache.h"
+#include "template.h"
+#include "wcdb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Bump when the layout of the cache files changes
+#define CACHE_MAGIC     "svnwcrev-cache 3"
+#define TEMPLATE_MAGIC  "svnwcrev-template 2"
+
+std::string CacheDefaultDir()
+{
+    const char * xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg)
+        return std::string(xdg) + "/svnwcrev";
+    const char * home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.cache/svnwcrev";
+}
+
+// Create dir and all its missing parents.
+static bool MakeDirs(const std::string & dir)
+{
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1))
+    {
+        std::string parent = dir.substr(0, pos);
+        if ((mkdir(parent.c_str(), 0777) != 0) && (errno != EEXIST))
+            return false;
+        if (pos == std::string::npos)
+            return true;
+    }
+}
+
+// Open a temporary file next to file for a new cache entry. Concurrent
+// runs never see half an entry, since CommitEntry() renames it.
+static FILE * CreateEntry(const std::string & file, std::string & tmpfile)
+{
+    std::string dir = file.substr(0, file.rfind('/'));
+    if (!MakeDirs(dir))
+        return NULL;
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%ld.%ld.tmp", (long)getpid(), (long)syscall(SYS_gettid));
+    tmpfile = file + suffix;
+    return fopen(tmpfile.c_str(), "w");
+}
+
+static void CommitEntry(FILE * f, const std::string & tmpfile, const std::string & file)
+{
+    if ((fclose(f) != 0) || (rename(tmpfile.c_str(), file.c_str()) != 0))
+        unlink(tmpfile.c_str());
+}
+
+static void WriteString(FILE * f, const char * str)
+{
+    fprintf(f, "%zu:%s\n", strlen(str), str);
+}
+
+static bool ReadString(FILE * f, char * dest, size_t buf_len)
+{
+    size_t len = 0;
+    if ((fscanf(f, "%zu:", &len) != 1) || (len >= buf_len))
+        return false;
+    if (fread(dest, 1, len, f) != len)
+        return false;
+    dest[len] = 0;
+    return fgetc(f) == '\n';
+}
+
+// Entries collected with text modifications carry a fingerprint which
+// includes the versioned files, the others one of the directories only.
+// The files are looked at only if such an entry has to be checked.
+static bool Matches(SubWcCache_t * cache, const char * path, bool bExternals, apr_uint64_t fingerprint,
+                    unsigned entryskip, unsigned skip, apr_pool_t * pool)
+{
+    if (entryskip & ~skip)
+        return false;
+    if (((entryskip & SKIP_TEXT_MODS) == 0) == cache->bFiles)
+        return fingerprint == cache->Fingerprint;
+    if (!cache->bFilePrint)
+        cache->bFilePrint = WcDbFingerprint(path, bExternals, true, &cache->FilePrint, pool);
+    return cache->bFilePrint && (fingerprint == cache->FilePrint);
+}
+
+static bool ReadEntry(FILE * f, SubWcCache_t * cache, const char * path, unsigned skip, SubWCRev_t * SubStat,
+                      apr_pool_t * pool)
+{
+    char line[URL_BUF];
+    if (!ReadString(f, line, sizeof(line)) || (strcmp(line, CACHE_MAGIC) != 0))
+        return false;
+    if (!ReadString(f, line, sizeof(line)) || (cache->Key != line))
+        return false;
+
+    unsigned long long fingerprint = 0;
+    unsigned entryskip = 0;
+    if ((fscanf(f, "%llx %x\n", &fingerprint, &entryskip) != 2) ||
+        !Matches(cache, path, SubStat->bExternals, fingerprint, entryskip, skip, pool))
+        return false;
+
+    // read into a copy, so a damaged entry leaves SubStat untouched
+    SubWCRev_t * Stat = new SubWCRev_t;
+    memcpy(Stat, SubStat, sizeof(SubWCRev_t));
+    long long MinRev, MaxRev, CmtRev, CmtDate, LockDate;
+    int HasMods, HasUnversioned, IsSvnItem, IsExternalsNotFixed, IsExternalMixed,
+        IsTagged, ItemSeen, NeedsLockSeen, NeedsLocks, IsLocked;
+    bool ret = (fscanf(f, "%lld %lld %lld %lld %lld\n", &MinRev, &MaxRev, &CmtRev, &CmtDate, &LockDate) == 5) &&
+               (fscanf(f, "%d %d %d %d %d %d %d %d %d %d\n", &HasMods, &HasUnversioned, &IsSvnItem,
+                       &IsExternalsNotFixed, &IsExternalMixed, &IsTagged, &ItemSeen, &NeedsLockSeen,
+                       &NeedsLocks, &IsLocked) == 10) &&
+               ReadString(f, Stat->Url, sizeof(Stat->Url)) &&
+               ReadString(f, Stat->RootUrl, sizeof(Stat->RootUrl)) &&
+               ReadString(f, Stat->Author, sizeof(Stat->Author)) &&
+               ReadString(f, Stat->LockData.Owner, sizeof(Stat->LockData.Owner)) &&
+               ReadString(f, Stat->LockData.Comment, sizeof(Stat->LockData.Comment));
+    if (ret)
+    {
+        Stat->MinRev = (svn_revnum_t)MinRev;
+        Stat->MaxRev = (svn_revnum_t)MaxRev;
+        Stat->CmtRev = (svn_revnum_t)CmtRev;
+        Stat->CmtDate = (apr_time_t)CmtDate;
+        Stat->LockData.CreationDate = (apr_time_t)LockDate;
+        Stat->HasMods = HasMods != 0;
+        Stat->HasUnversioned = HasUnversioned != 0;
+        Stat->bIsSvnItem = IsSvnItem != 0;
+        Stat->bIsExternalsNotFixed = IsExternalsNotFixed != 0;
+        Stat->bIsExternalMixed = IsExternalMixed != 0;
+        Stat->bIsTagged = IsTagged != 0;
+        Stat->bItemSeen = ItemSeen != 0;
+        Stat->bNeedsLockSeen = NeedsLockSeen != 0;
+        Stat->LockData.NeedsLocks = NeedsLocks != 0;
+        Stat->LockData.IsLocked = IsLocked != 0;
+        memcpy(SubStat, Stat, sizeof(SubWCRev_t));
+    }
+    delete Stat;
+    return ret;
+}
+
+bool CacheLoad(const char * cachedir, SubWcMemCache_t * memcache, const char * path, unsigned skip,
+               SubWCRev_t * SubStat, SubWcCache_t * cache, apr_pool_t * pool)
+{
+    // the options which change what is collected are part of the key
+    cache->Key = path;
+    cache->Key += SubStat->bFolders ? " -f" : " -";
+    cache->Key += SubStat->bExternals ? "e" : "";
+    cache->Key += SubStat->bExternalsNoMixedRevision ? "E" : "";
+    cache->Key += SubStat->bHexPlain ? "x" : "";
+    cache->Key += SubStat->bHexX ? "X" : "";
+
+    cache->Mem = memcache;
+    cache->File.clear();
+    if (cachedir)
+    {
+        apr_uint64_t name = HASH_INIT;
+        HashBytes(&name, cache->Key.data(), cache->Key.size());
+        char filename[32];
+        snprintf(filename, sizeof(filename), "/%016llx", (unsigned long long)name);
+        cache->File = std::string(cachedir) + filename;
+    }
+
+    // a cache hit should not cost a stat of every file, so unless text
+    // modifications are asked for, only the directories are looked at
+    cache->bFiles = !(skip & SKIP_TEXT_MODS);
+    cache->bFilePrint = false;
+    cache->bValid = WcDbFingerprint(path, SubStat->bExternals, cache->bFiles, &cache->Fingerprint, pool);
+    if (!cache->bValid)
+        return false;
+
+    if (memcache)
+    {
+        bool bHit = false;
+        if (memcache->Lock)
+            apr_thread_mutex_lock(memcache->Lock);
+        std::map<std::string, SubWcCacheEntry_t>::const_iterator I = memcache->Entries.find(cache->Key);
+        if ((I != memcache->Entries.end()) &&
+            Matches(cache, path, SubStat->bExternals, I->second.Fingerprint, I->second.Skip, skip, pool))
+        {
+            // the options are part of the key, only the thread count may differ
+            int Threads = SubStat->Threads;
+            memcpy(SubStat, &I->second.SubStat, sizeof(SubWCRev_t));
+            SubStat->Threads = Threads;
+            bHit = true;
+        }
+        if (memcache->Lock)
+            apr_thread_mutex_unlock(memcache->Lock);
+        if (bHit)
+            return true;
+    }
+    if (cache->File.empty())
+        return false;
+
+    FILE * f = fopen(cache->File.c_str(), "r");
+    if (f == NULL)
+        return false;
+    bool ret = ReadEntry(f, cache, path, skip, SubStat, pool);
+    fclose(f);
+    return ret;
+}
+
+void CacheStore(const SubWcCache_t * cache, unsigned skip, const SubWCRev_t * SubStat)
+{
+    if (!cache->bValid)
+        return;
+    // Without the files in the fingerprint, the entry can not tell
+    // whether they were edited since: store it as if text
+    // modifications had been skipped.
+    if (!cache->bFiles)
+        skip |= SKIP_TEXT_MODS;
+    if (cache->Mem)
+    {
+        if (cache->Mem->Lock)
+            apr_thread_mutex_lock(cache->Mem->Lock);
+        SubWcCacheEntry_t & entry = cache->Mem->Entries[cache->Key];
+        entry.Fingerprint = cache->Fingerprint;
+        entry.Skip = skip;
+        memcpy(&entry.SubStat, SubStat, sizeof(SubWCRev_t));
+        if (cache->Mem->Lock)
+            apr_thread_mutex_unlock(cache->Mem->Lock);
+    }
+    if (cache->File.empty())
+        return;
+    std::string tmpfile;
+    FILE * f = CreateEntry(cache->File, tmpfile);
+    if (f == NULL)
+        return;
+    WriteString(f, CACHE_MAGIC);
+    WriteString(f, cache->Key.c_str());
+    fprintf(f, "%llx %x\n", (unsigned long long)cache->Fingerprint, skip);
+    fprintf(f, "%lld %lld %lld %lld %lld\n", (long long)SubStat->MinRev, (long long)SubStat->MaxRev,
+            (long long)SubStat->CmtRev, (long long)SubStat->CmtDate, (long long)SubStat->LockData.CreationDate);
+    fprintf(f, "%d %d %d %d %d %d %d %d %d %d\n", SubStat->HasMods, SubStat->HasUnversioned, SubStat->bIsSvnItem,
+            SubStat->bIsExternalsNotFixed, SubStat->bIsExternalMixed, SubStat->bIsTagged, SubStat->bItemSeen,
+            SubStat->bNeedsLockSeen, SubStat->LockData.NeedsLocks, SubStat->LockData.IsLocked);
+    WriteString(f, SubStat->Url);
+    WriteString(f, SubStat->RootUrl);
+    WriteString(f, SubStat->Author);
+    WriteString(f, SubStat->LockData.Owner);
+    WriteString(f, SubStat->LockData.Comment);
+    CommitEntry(f, tmpfile, cache->File);
+}
+
+// The file holding the compiled template with the given content hash.
+static std::string TemplateFile(const char * cachedir, apr_uint64_t hash)
+{
+    char filename[40];
+    snprintf(filename, sizeof(filename), "/templates/%016llx", (unsigned long long)hash);
+    return std::string(cachedir) + filename;
+}
+
+bool TemplateCacheLoad(const char * cachedir, apr_uint64_t hash, size_t length, SubWcTemplate_t * tmpl)
+{
+    FILE * f = fopen(TemplateFile(cachedir, hash).c_str(), "r");
+    if (f == NULL)
+        return false;
+
+    char line[64];
+    unsigned long long entryhash = 0;
+    size_t entrylength = 0, ops = 0, literals = 0;
+    unsigned fields = 0;
+    int interpret = 0;
+    bool ret = ReadString(f, line, sizeof(line)) && (strcmp(line, TEMPLATE_MAGIC) == 0) &&
+               (fscanf(f, "%llx %zu %x %d %zu %zu", &entryhash, &entrylength, &fields, &interpret,
+                       &ops, &literals) == 6) && (fgetc(f) == '\n') &&
+               (entryhash == hash) && (entrylength == length) && (ops <= length + 1) && (literals <= length);
+    if (ret)
+    {
+        tmpl->Fields = fields;
+        tmpl->bInterpret = interpret != 0;
+        tmpl->Literals.resize(literals);
+        tmpl->Ops.resize(ops);
+        ret = (fread(&tmpl->Literals[0], 1, literals, f) == literals) && (fgetc(f) == '\n');
+    }
+    for (size_t i = 0; ret && (i < ops); ++i)
+    {
+        // a damaged entry must not send the expansion out of bounds
+        int op = 0, field = 0;
+        unsigned a = 0, b = 0;
+        ret = (fscanf(f, "%d %d %x %x\n", &op, &field, &a, &b) == 4) &&
+              (op >= TOP_LITERAL) && (op <= TOP_BOOLEAN) && (field >= WCF_REV) && (field <= WCF_UNVER) &&
+              ((op != TOP_LITERAL) || (((size_t)a <= literals) && ((size_t)b <= literals - a))) &&
+              ((op != TOP_BOOLEAN) || (((size_t)a <= ops - i - 1) && ((size_t)b <= ops - i - 1 - a)));
+        tmpl->Ops[i].Op = (SubWcTemplateOpCode_t)op;
+        tmpl->Ops[i].Field = (SubWcField_t)field;
+        tmpl->Ops[i].A = a;
+        tmpl->Ops[i].B = b;
+    }
+    fclose(f);
+    return ret;
+}
+
+void TemplateCacheStore(const char * cachedir, apr_uint64_t hash, size_t length, const SubWcTemplate_t * tmpl)
+{
+    std::string file = TemplateFile(cachedir, hash);
+    std::string tmpfile;
+    FILE * f = CreateEntry(file, tmpfile);
+    if (f == NULL)
+        return;
+    WriteString(f, TEMPLATE_MAGIC);
+    fprintf(f, "%llx %zu %x %d %zu %zu\n", (unsigned long long)hash, length, tmpl->Fields,
+            tmpl->bInterpret ? 1 : 0, tmpl->Ops.size(), tmpl->Literals.size());
+    fwrite(tmpl->Literals.data(), 1, tmpl->Literals.size(), f);
+    fputc('\n', f);
+    for (std::vector<SubWcTemplateOp_t>::const_iterator I = tmpl->Ops.begin(); I != tmpl->Ops.end(); ++I)
+        fprintf(f, "%d %d %x %x\n", (int)I->Op, (int)I->Field, I->A, I->B);
+    CommitEntry(f, tmpfile, file);
+}
@@ -0,0 +1,100 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#pragma once
+#include <string>
+#include <map>
+#include <apr_thread_mutex.h>
+#include "SVNWcRev.h"
+#include "template.h"
+
+/**
+ * \ingroup SubWCRev
+ * A cached crawl result as kept in memory by a long-lived context.
+ */
+typedef struct SubWcCacheEntry_t
+{
+    apr_uint64_t Fingerprint;   // fingerprint of the working copy before the crawl
+    unsigned Skip;              // SKIP_xxx: the parts of the crawl left out
+    SubWCRev_t SubStat;
+} SubWcCacheEntry_t;
+
+/**
+ * \ingroup SubWCRev
+ * The in-memory cache, shared by all queries of one context.
+ */
+typedef struct SubWcMemCache_t
+{
+    std::map<std::string, SubWcCacheEntry_t> Entries;
+    apr_thread_mutex_t * Lock;  // guards Entries, NULL if used by one thread only
+} SubWcMemCache_t;
+
+/**
+ * \ingroup SubWCRev
+ * One entry of the on-disk status cache: where it lives and the
+ * fingerprint of the working copy it has to match.
+ */
+typedef struct SubWcCache_t
+{
+    std::string File;           // cache file of this working copy and these options, or empty
+    SubWcMemCache_t * Mem;      // in-memory cache, or NULL
+    std::string Key;            // working copy path and options, stored in File
+    apr_uint64_t Fingerprint;   // fingerprint of the working copy before the crawl
+    bool bFiles;                // Fingerprint includes the versioned files
+    bool bValid;                // FALSE if no fingerprint could be computed
+    apr_uint64_t FilePrint;     // the fingerprint with the files, once bFilePrint
+    bool bFilePrint;
+} SubWcCache_t;
+
+/**
+ * \ingroup SubWCRev
+ * Returns the cache directory used by --cache without a directory:
+ * $XDG_CACHE_HOME/svnwcrev or ~/.cache/svnwcrev.
+ */
+std::string CacheDefaultDir();
+
+/**
+ * \ingroup SubWCRev
+ * Looks up the status of the working copy at path, crawled with the options
+ * in SubStat, in memcache and then in cachedir; either may be NULL. If the cached entry matches the current fingerprint
+ * of the working copy, the collected fields of SubStat are filled from it and
+ * TRUE is returned. Only entries which skipped no more than skip (SKIP_xxx)
+ * of the crawl are used. cache is set up for a later CacheStore() either way.
+ */
+bool CacheLoad(const char * cachedir, SubWcMemCache_t * memcache, const char * path, unsigned skip,
+               SubWCRev_t * SubStat, SubWcCache_t * cache, apr_pool_t * pool);
+
+/**
+ * \ingroup SubWCRev
+ * Stores the collected fields of SubStat, made with skip (SKIP_xxx) left
+ * out of the crawl, in the cache entries set up by CacheLoad(). Failing to write the cache is not an error.
+ */
+void CacheStore(const SubWcCache_t * cache, unsigned skip, const SubWCRev_t * SubStat);
+
+/**
+ * \ingroup SubWCRev
+ * Looks up the compiled form of a template of length bytes with the content
+ * hash hash (HashBytes()) in cachedir. Returns FALSE if there is none.
+ */
+bool TemplateCacheLoad(const char * cachedir, apr_uint64_t hash, size_t length, SubWcTemplate_t * tmpl);
+
+/**
+ * \ingroup SubWCRev
+ * Stores the compiled template tmpl in cachedir for TemplateCacheLoad().
+ * Failing to write the cache is not an error.
+ */
+void TemplateCacheStore(const char * cachedir, apr_uint64_t hash, size_t length, const SubWcTemplate_t * tmpl);
@@ -0,0 +1,337 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// The protocol is a single request and answer per connection.
+// Request: the number of strings, then the current directory and the
+// arguments. Answer: the exit code, the messages and the errors.
+// Numbers are 32 bit in host byte order, strings are a length followed
+// by that many bytes.
+
+#include <apr_pools.h>
+#include "daemon.h"
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Limits to keep a broken client from exhausting the daemon
+#define MAX_ARGS        1024
+#define MAX_ARG_LEN     (1024 * 1024)
+// The answer holds all the output of a run, e.g. a long --batch table
+#define MAX_ANSWER_LEN  0x7fffffff
+// Seconds a client may take to send its request or read the answer
+#define DAEMON_TIMEOUT  30
+// Connections served at the same time; more wait to be accepted
+#define MAX_CLIENTS     64
+
+std::string DaemonDefaultSocket()
+{
+    const char * runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime)
+        return std::string(runtime) + "/svnwcrev.sock";
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/svnwcrev-%ld.sock", (long)getuid());
+    return path;
+}
+
+static bool WriteAll(int fd, const void * data, size_t len)
+{
+    const char * p = (const char *)data;
+    while (len)
+    {
+        // no SIGPIPE in the client if the daemon goes away
+        ssize_t written = send(fd, p, len, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += written;
+        len -= written;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void * data, size_t len)
+{
+    char * p = (char *)data;
+    while (len)
+    {
+        ssize_t readlength = read(fd, p, len);
+        if (readlength < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (readlength == 0)
+            return false;
+        p += readlength;
+        len -= readlength;
+    }
+    return true;
+}
+
+static bool WriteNumber(int fd, int32_t value)
+{
+    return WriteAll(fd, &value, sizeof(value));
+}
+
+static bool WriteString(int fd, const char * str, size_t len)
+{
+    return WriteNumber(fd, (int32_t)len) && WriteAll(fd, str, len);
+}
+
+static bool ReadNumber(int fd, int32_t * value)
+{
+    return ReadAll(fd, value, sizeof(*value));
+}
+
+static bool ReadString(int fd, std::string & str, int32_t maxlen)
+{
+    int32_t len = 0;
+    if (!ReadNumber(fd, &len) || (len < 0) || (len > maxlen))
+        return false;
+    str.resize(len);
+    return (len == 0) || ReadAll(fd, &str[0], len);
+}
+
+static bool MakeAddress(const char * socketpath, struct sockaddr_un * addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socketpath) >= sizeof(addr->sun_path))
+        return false;
+    strcpy(addr->sun_path, socketpath);
+    return true;
+}
+
+// Read one request, run it and send the answer back.
+static void ServeRequest(int fd, SubWcRunFunc_t run, SubWcContext * context)
+{
+    int32_t count = 0;
+    if (!ReadNumber(fd, &count) || (count < 2) || (count > MAX_ARGS))
+        return;
+    std::vector<std::string> strings(count);
+    for (int i = 0; i < count; ++i)
+    {
+        if (!ReadString(fd, strings[i], MAX_ARG_LEN))
+            return;
+    }
+
+    char * outbuf = NULL;
+    size_t outlen = 0;
+    char * errbuf = NULL;
+    size_t errlen = 0;
+    FILE * out = open_memstream(&outbuf, &outlen);
+    FILE * err = open_memstream(&errbuf, &errlen);
+    // The requests run side by side, so instead of changing to the
+    // directory of the client, run takes the paths relative to it.
+    int exitcode = 0;
+    struct stat cwdStatus;
+    if ((out == NULL) || (err == NULL))
+        exitcode = ERR_ALLOC;
+    else if ((strings[0][0] != '/') || (stat(strings[0].c_str(), &cwdStatus) != 0) || !S_ISDIR(cwdStatus.st_mode))
+    {
+        fprintf(err, "svnwcrev : can not change to directory '%s'\n", strings[0].c_str());
+        exitcode = ERR_FNF;
+    }
+    else
+    {
+        std::vector<char *> argv;
+        for (int i = 1; i < count; ++i)
+            argv.push_back(&strings[i][0]);
+        argv.push_back(NULL);
+        exitcode = run(count - 1, &argv[0], strings[0].c_str(), out, err, context);
+    }
+    if (out)
+        fclose(out);
+    if (err)
+        fclose(err);
+
+    if (WriteNumber(fd, exitcode))
+    {
+        if (WriteString(fd, outbuf ? outbuf : "", outlen))
+            WriteString(fd, errbuf ? errbuf : "", errlen);
+    }
+    free(outbuf);
+    free(errbuf);
+}
+
+// One accepted connection, served by ServeConnection().
+typedef struct SubWcConnection_t
+{
+    int fd;
+    SubWcRunFunc_t run;
+    SubWcContext * context;
+} SubWcConnection_t;
+
+static pthread_mutex_t ClientsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ClientsDone = PTHREAD_COND_INITIALIZER;
+static int Clients = 0;         // connections being served
+
+static void * ServeConnection(void * data)
+{
+    SubWcConnection_t * conn = (SubWcConnection_t *)data;
+    ServeRequest(conn->fd, conn->run, conn->context);
+    close(conn->fd);
+    delete conn;
+
+    pthread_mutex_lock(&ClientsLock);
+    Clients--;
+    pthread_cond_signal(&ClientsDone);
+    pthread_mutex_unlock(&ClientsLock);
+    return NULL;
+}
+
+int DaemonServe(const char * socketpath, SubWcRunFunc_t run, SubWcContext * context)
+{
+    struct sockaddr_un addr;
+    if (!MakeAddress(socketpath, &addr))
+    {
+        printf("Socket path '%s' is too long\n", socketpath);
+        return ERR_SYNTAX;
+    }
+    // A socket left behind by a daemon which did not exit cleanly is
+    // replaced; one a daemon still answers on is not.
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe != -1)
+    {
+        int connected = connect(probe, (struct sockaddr *)&addr, sizeof(addr));
+        int error = errno;
+        close(probe);
+        if (connected == 0)
+        {
+            printf("svnwcrev daemon already running on '%s'\n", socketpath);
+            return ERR_OPEN;
+        }
+        if ((error != ECONNREFUSED) && (error != ENOENT))
+        {
+            printf("Unable to use socket '%s'\n", socketpath);
+            return ERR_OPEN;
+        }
+    }
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd == -1)
+    {
+        printf("Unable to create socket '%s'\n", socketpath);
+        return ERR_OPEN;
+    }
+    unlink(socketpath);
+    // only the user running the daemon may talk to it
+    mode_t oldmask = umask(077);
+    int bound = bind(listenfd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(oldmask);
+    if ((bound != 0) || (listen(listenfd, 16) != 0))
+    {
+        printf("Unable to listen on socket '%s'\n", socketpath);
+        close(listenfd);
+        return ERR_OPEN;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    printf("svnwcrev daemon listening on '%s'\n", socketpath);
+    fflush(stdout);
+
+    for (;;)
+    {
+        int fd = accept(listenfd, NULL, NULL);
+        if (fd == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        // A client which stalls must not keep the daemon waiting, nor
+        // the clients after it, which are served on threads of their own.
+        struct timeval timeout;
+        timeout.tv_sec = DAEMON_TIMEOUT;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        pthread_mutex_lock(&ClientsLock);
+        while (Clients >= MAX_CLIENTS)
+            pthread_cond_wait(&ClientsDone, &ClientsLock);
+        Clients++;
+        pthread_mutex_unlock(&ClientsLock);
+
+        SubWcConnection_t * conn = new SubWcConnection_t;
+        conn->fd = fd;
+        conn->run = run;
+        conn->context = context;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, ServeConnection, conn) != 0)
+            ServeConnection(conn);
+        pthread_attr_destroy(&attr);
+    }
+    printf("Unable to accept connections on socket '%s'\n", socketpath);
+    close(listenfd);
+    unlink(socketpath);
+    return ERR_OPEN;
+}
+
+bool DaemonClient(const char * socketpath, int argc, char ** argv, int * exitcode)
+{
+    struct sockaddr_un addr;
+    if (!MakeAddress(socketpath, &addr))
+        return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return false;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    char * cwd = getcwd(NULL, 0);
+    bool ret = (cwd != NULL) && WriteNumber(fd, argc + 1) && WriteString(fd, cwd, strlen(cwd));
+    free(cwd);
+    for (int i = 0; ret && (i < argc); ++i)
+        ret = WriteString(fd, argv[i], strlen(argv[i]));
+
+    int32_t code = 0;
+    std::string out;
+    std::string err;
+    ret = ret && ReadNumber(fd, &code) && ReadString(fd, out, MAX_ANSWER_LEN) &&
+          ReadString(fd, err, MAX_ANSWER_LEN);
+    close(fd);
+    if (!ret)
+    {
+        // the daemon may have written the outputs already: no second run
+        fprintf(stderr, "svnwcrev : no valid answer from the daemon on '%s'\n", socketpath);
+        *exitcode = ERR_READ;
+        return true;
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    fwrite(err.data(), 1, err.size(), stderr);
+    *exitcode = code;
+    return true;
+}
@@ -0,0 +1,56 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#pragma once
+#include <stdio.h>
+#include <string>
+#include "SVNWcRev.h"
+#include "libsvnwcrev.h"
+
+/**
+ * \ingroup SubWCRev
+ * Runs svnwcrev with the given command line, writing messages to out and
+ * errors to err. Relative paths are taken relative to cwd, or to the
+ * current directory if cwd is NULL. Returns the exit code.
+ */
+typedef int (*SubWcRunFunc_t)(int argc, char ** argv, const char * cwd, FILE * out, FILE * err,
+                              SubWcContext * context);
+
+/**
+ * \ingroup SubWCRev
+ * Returns the socket used if none is given:
+ * $XDG_RUNTIME_DIR/svnwcrev.sock or /tmp/svnwcrev-<uid>.sock.
+ */
+std::string DaemonDefaultSocket();
+
+/**
+ * \ingroup SubWCRev
+ * Listens on the Unix socket socketpath and answers the requests of
+ * DaemonClient() with run, all in context, each connection on a thread
+ * of its own. Only returns on error.
+ */
+int DaemonServe(const char * socketpath, SubWcRunFunc_t run, SubWcContext * context);
+
+/**
+ * \ingroup SubWCRev
+ * Hands the command line and the current directory over to the daemon
+ * listening on socketpath and prints its answer. Returns FALSE if no
+ * daemon could be reached; the caller then has to do the work itself.
+ * Once connected, the daemon may have run the request, so a broken
+ * answer is reported and sets exitcode to ERR_READ instead.
+ */
+bool DaemonClient(const char * socketpath, int argc, char ** argv, int * exitcode);
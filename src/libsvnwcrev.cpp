@@ -0,0 +1,703 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <apr_general.h>
+#include <apr_pools.h>
+#include <apr_thread_proc.h>
+#include <apr_atomic.h>
+#include <svn_client.h>
+#include <svn_dirent_uri.h>
+#include <svn_dso.h>
+#include <svn_utf.h>
+#include <svn_wc.h>
+#include "libsvnwcrev.h"
+#include "template.h"
+#include "wcdb.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+static int abort_on_pool_failure(int /*retcode*/)
+{
+    abort();
+    return -1;
+}
+
+SubWcContext::SubWcContext(bool bMemCache)
+    : Lock(NULL)
+    , MemCache(NULL)
+{
+    StartNs = StatsNow();
+    apr_initialize();
+    svn_dso_initialize2();
+    apr_pool_create_ex(&pool, NULL, abort_on_pool_failure, NULL);
+    StatsInit();
+    if (apr_thread_mutex_create(&Lock, APR_THREAD_MUTEX_DEFAULT, pool) != APR_SUCCESS)
+        Lock = NULL;
+
+    if (getenv("SVN_ASP_DOT_NET_HACK"))
+    {
+        svn_wc_set_adm_dir("_svn", pool);
+    }
+
+    if (bMemCache)
+    {
+        MemCache = new SubWcMemCache_t;
+        if (apr_thread_mutex_create(&MemCache->Lock, APR_THREAD_MUTEX_DEFAULT, pool) != APR_SUCCESS)
+            MemCache->Lock = NULL;
+    }
+
+    // The first client is made right away, most users need no other.
+    apr_int64_t context = StatsNow();
+    SubWcClient_t client;
+    svn_error_t * svnerr = AcquireClient(&client);
+    if (svnerr)
+        svn_error_clear(svnerr);    // reported again by the first query
+    else
+        ReleaseClient(&client);
+    apr_int64_t end = StatsNow();
+    InitNs = context - StartNs;
+    ContextNs = end - context;
+}
+
+SubWcContext::~SubWcContext()
+{
+    delete MemCache;
+    // the clients live in subpools of pool
+    apr_pool_destroy(pool);
+    apr_terminate2();
+}
+
+// Take an idle client or make a new one.
+svn_error_t * SubWcContext::AcquireClient(SubWcClient_t * client)
+{
+    if (Lock)
+        apr_thread_mutex_lock(Lock);
+    bool bIdle = !Clients.empty();
+    if (bIdle)
+    {
+        *client = Clients.back();
+        Clients.pop_back();
+    }
+    else
+    {
+        // Subpools are created under the parent's lock, which is
+        // the only thing clients share.
+        apr_pool_create(&client->pool, pool);
+    }
+    if (Lock)
+        apr_thread_mutex_unlock(Lock);
+    if (bIdle)
+        return SVN_NO_ERROR;
+
+    svn_error_t * svnerr = svn_client_create_context(&client->ctx, client->pool);
+    if (svnerr)
+    {
+        if (Lock)
+            apr_thread_mutex_lock(Lock);
+        apr_pool_destroy(client->pool);
+        if (Lock)
+            apr_thread_mutex_unlock(Lock);
+    }
+    return svnerr;
+}
+
+void SubWcContext::ReleaseClient(const SubWcClient_t * client)
+{
+    if (Lock)
+        apr_thread_mutex_lock(Lock);
+    Clients.push_back(*client);
+    if (Lock)
+        apr_thread_mutex_unlock(Lock);
+}
+
+svn_error_t * SubWcContext::GetStatus(const char * path, const SubWcQuery_t * query,
+                                      SubWCRev_t * SubStat, SubWcQueryInfo_t * info)
+{
+    SubWcClient_t client;
+    svn_error_t * svnerr = AcquireClient(&client);
+    if (svnerr)
+        return svnerr;
+
+    apr_pool_t * querypool;
+    apr_pool_create(&querypool, client.pool);
+
+    char * fullpath = realpath(path, NULL);
+    const char * utf8Path = NULL;
+    svnerr = svn_utf_cstring_to_utf8(&utf8Path, fullpath ? fullpath : path, querypool);
+    free(fullpath);
+    if (svnerr)
+    {
+        apr_pool_destroy(querypool);
+        ReleaseClient(&client);
+        return svnerr;
+    }
+    const char * internalpath = svn_dirent_internal_style(utf8Path, querypool);
+
+    // Only do the parts of the crawl whose results are needed by the
+    // templates or the checks.
+    // Revisions and the URL alone can be read from wc.db directly, which
+    // is much faster than crawling the working copy.
+    bool bRevisionsOnly = !query->bErrOnMods && !SubStat->bExternals && !SubStat->bExternalsNoMixedRevision &&
+                          ((query->Fields & ~WCDB_FIELDS) == 0);
+    // Unversioned items are looked for only for $WCUNVER?...$: that means
+    // reading every directory which is not under version control, build
+    // output included. $WCINSVN?...$ and the lock fields come from the
+    // last node reported, which may be unversioned or ignored, so for
+    // them the crawl reports everything.
+    SubStat->Skip = 0;
+    if (!(query->Fields & WCF_LAST_NODE))
+    {
+        SubStat->Skip |= SKIP_IGNORED;
+        if (!(query->Fields & WCF_MASK(WCF_UNVER)))
+            SubStat->Skip |= SKIP_UNVERSIONED;
+    }
+    if (!query->bErrOnMods && !(query->Fields & WCF_MASK(WCF_MODS)))
+        SubStat->Skip |= SKIP_TEXT_MODS;
+    else if (SubStat->bTrustTimestamps)
+        SubStat->Skip |= SKIP_TEXT_COMPARE;
+    if (!(query->Fields & WCF_MASK(WCF_NEEDSLOCK)))
+        SubStat->Skip |= SKIP_NEEDS_LOCK;
+    unsigned skip = bRevisionsOnly ? SKIP_ALL : SubStat->Skip;
+
+    // A gate check can stop the crawl as soon as its outcome is known.
+    // Local modifications take precedence, so -m alone may stop at the
+    // first mixed revision only if -n is not given.
+    SubStat->bStopOnMods = query->bErrOnMods && !query->bComplete;
+    SubStat->bStopOnMixed = query->bErrOnMixed && !query->bErrOnMods && !query->bComplete;
+
+    SubWcCache_t cache;
+    bool bCached = false;
+    bool bUseCache = (query->CacheDir != NULL) || (MemCache != NULL);
+    if (bUseCache)
+    {
+        apr_int64_t start = StatsNow();
+        bCached = CacheLoad(query->CacheDir, MemCache, internalpath, skip, SubStat, &cache, querypool);
+        StatsAddPhase(PHASE_CACHE, start);
+    }
+    const char * source = "cache";
+    if (!bCached)
+    {
+        source = "wc.db";
+        apr_int64_t start = StatsNow();
+        bool bWcDb = bRevisionsOnly && WcDbGetRevisions(internalpath, SubStat, querypool);
+        StatsAddPhase(PHASE_WCDB, start);
+        if (!bWcDb)
+        {
+            source = "status crawl";
+            skip = SubStat->Skip;
+            start = StatsNow();
+            svnerr = svn_status(    internalpath,   //path
+                                    SubStat,        //status_baton
+                                    !(SubStat->Skip & SKIP_IGNORED),    //noignore
+                                    client.ctx,
+                                    querypool);
+            StatsAddPhase(PHASE_CRAWL, start);
+        }
+        if (bUseCache && !svnerr && !SubStat->bStopped)
+            CacheStore(&cache, skip, SubStat);
+    }
+    if (info)
+    {
+        info->Source = source;
+        info->Skip = skip;
+        info->bCacheHit = bCached;
+    }
+
+    apr_pool_destroy(querypool);
+    ReleaseClient(&client);
+    return svnerr;
+}
+
+// Work shared by the threads of a batch query.
+typedef struct SubWcBatchWork_t
+{
+    SubWcContext * context;
+    std::vector<SubWcBatchItem_t> * items;
+    const SubWcQuery_t * query;
+    volatile apr_uint32_t next;     // index of the next working copy
+} SubWcBatchWork_t;
+
+static void batchlist(SubWcBatchWork_t * work)
+{
+    for (;;)
+    {
+        apr_uint32_t i = apr_atomic_inc32(&work->next);
+        if (i >= work->items->size())
+            break;
+        SubWcBatchItem_t & item = (*work->items)[i];
+        apr_int64_t start = StatsNow();
+        item.Err = work->context->GetStatus(item.Path.c_str(), work->query, &item.SubStat, &item.Info);
+        TraceSpan("working copy", "batch", start, StatsNow(), item.Path.c_str());
+    }
+}
+
+static void * APR_THREAD_FUNC batchthread(apr_thread_t * thread, void * data)
+{
+    batchlist((SubWcBatchWork_t *) data);
+    apr_thread_exit(thread, APR_SUCCESS);
+    return NULL;
+}
+
+void SubWcContext::GetStatusBatch(std::vector<SubWcBatchItem_t> & items, const SubWcQuery_t * query, int threads)
+{
+    SubWcBatchWork_t work;
+    work.context = this;
+    work.items = &items;
+    work.query = query;
+    work.next = 0;
+
+    // The threads only live in this pool; the queries have pools of their own.
+    apr_pool_t * threadpool = NULL;
+    apr_pool_create_ex(&threadpool, NULL, abort_on_pool_failure, NULL);
+    std::vector<apr_thread_t *> workers;
+    threads = std::min<int>(threads, (int)items.size());
+    for (int i = 0; (i < threads) && (threads > 1); ++i)
+    {
+        apr_thread_t * thread = NULL;
+        if (apr_thread_create(&thread, NULL, batchthread, &work, threadpool) == APR_SUCCESS)
+            workers.push_back(thread);
+    }
+    if (workers.empty())
+        batchlist(&work);
+    for (std::vector<apr_thread_t *>::iterator I = workers.begin(); I != workers.end(); ++I)
+    {
+        apr_status_t retval;
+        apr_thread_join(&retval, *I);
+    }
+    apr_pool_destroy(threadpool);
+}
+
+// Map the whole template file src into memory. Release with FreeTemplate().
+static int MapTemplate(const char * src, const char ** ppBuf, size_t * pFilelength,
+                       struct stat * inputStatus, FILE * messages)
+{
+    // open the file and map the contents
+    int hFile = open(src, O_RDONLY);
+    if (hFile == -1)
+    {
+        fprintf(messages, "Unable to open input file '%s'\n", src);
+        return ERR_OPEN;        // error opening file
+    }
+
+    if (fstat(hFile, inputStatus) != 0)
+    {
+        fprintf(messages, "Could not determine filesize of '%s'\n", src);
+        close(hFile);
+        return ERR_READ;
+    }
+
+    size_t filelength = inputStatus->st_size;
+
+    if (filelength == 0)
+    {
+        fprintf(messages, "Could not determine filesize of '%s'\n", src);
+        close(hFile);
+        return ERR_READ;
+    }
+    void * pBuf = mmap(NULL, filelength, PROT_READ, MAP_PRIVATE, hFile, 0);
+    close(hFile);
+    if (pBuf == MAP_FAILED)
+    {
+        fprintf(messages, "Could not read the file '%s'\n", src);
+        return ERR_READ;
+    }
+    madvise(pBuf, filelength, MADV_SEQUENTIAL);
+    *ppBuf = (const char *)pBuf;
+    *pFilelength = filelength;
+    return 0;
+}
+
+static void FreeTemplate(const char * pBuf, size_t filelength)
+{
+    if (pBuf)
+        munmap((void *)pBuf, filelength);
+}
+
+// True if the file dst exists and has exactly the content output.
+static bool HasContent(const char * dst, const std::string & output)
+{
+    int hFile = open(dst, O_RDONLY);
+    if (hFile == -1)
+        return false;
+
+    struct stat status;
+    bool same = (fstat(hFile, &status) == 0) && S_ISREG(status.st_mode) &&
+                ((size_t)status.st_size == output.size());
+    if (same && !output.empty())
+    {
+        void * pBufExisting = mmap(NULL, output.size(), PROT_READ, MAP_PRIVATE, hFile, 0);
+        same = (pBufExisting != MAP_FAILED) && (memcmp(output.data(), pBufExisting, output.size()) == 0);
+        if (pBufExisting != MAP_FAILED)
+            munmap(pBufExisting, output.size());
+    }
+    close(hFile);
+    return same;
+}
+
+// Write output to a temporary file next to dst and rename it to dst.
+static int WriteNewFile(const char * dst, const std::string & output, const struct stat * inputStatus,
+                        FILE * messages)
+{
+    std::string tmpfile = std::string(dst) + ".XXXXXX";
+    int hFile = mkstemp(&tmpfile[0]);
+    if (hFile == -1)
+    {
+        fprintf(messages, "Unable to open output file '%s' for writing\n", dst);
+        return ERR_OPEN;
+    }
+
+    size_t filelength = output.size();
+    const char * p = output.data();
+    while (filelength)
+    {
+        ssize_t writelength = write(hFile, p, filelength);
+        if (writelength <= 0)
+        {
+            fprintf(messages, "Could not write the file '%s' to the end!\n", dst);
+            close(hFile);
+            unlink(tmpfile.c_str());
+            return ERR_READ;
+        }
+        p += writelength;
+        filelength -= writelength;
+    }
+
+    // mkstemp creates the file with mode 0600; the output file
+    // gets the modes of the input file, as it always did.
+    fchmod(hFile, inputStatus->st_mode & 07777);
+    if (close(hFile) != 0)
+    {
+        fprintf(messages, "Could not write the file '%s' to the end!\n", dst);
+        unlink(tmpfile.c_str());
+        return ERR_READ;
+    }
+    if (rename(tmpfile.c_str(), dst) != 0)
+    {
+        fprintf(messages, "Unable to open output file '%s' for writing\n", dst);
+        unlink(tmpfile.c_str());
+        return ERR_OPEN;
+    }
+    return 0;
+}
+
+// Write the expanded template to dst, unless dst already has that content.
+// The new content goes to a temporary file next to dst which then replaces
+// dst, so nobody ever sees a partly written file.
+static int WriteVersionFile(const char * dst, const std::string & output, const struct stat * inputStatus,
+                            FILE * messages)
+{
+    apr_int64_t start = StatsNow();
+    // The file is only written if its contents would change.
+    // This prevents the timestamp from changing.
+    if (HasContent(dst, output))
+    {
+        Stats.FilesUnchanged++;
+        StatsAddPhase(PHASE_WRITE, start);
+        return 0;
+    }
+
+    // Replace the file a symbolic link points to, not the link.
+    char * target = NULL;
+    struct stat linkStatus;
+    if ((lstat(dst, &linkStatus) == 0) && S_ISLNK(linkStatus.st_mode))
+        target = realpath(dst, NULL);
+    if (target)
+        dst = target;
+    int ret = WriteNewFile(dst, output, inputStatus, messages);
+    free(target);
+    if (ret == 0)
+    {
+        Stats.FilesRewritten++;
+        Stats.BytesWritten += output.size();
+    }
+    StatsAddPhase(PHASE_WRITE, start);
+    return ret;
+}
+
+int SubWcContext::LoadTemplate(SubWcOutput_t * output, unsigned * fields, FILE * messages)
+{
+    apr_int64_t start = StatsNow();
+    output->pBuf = NULL;
+    output->Length = 0;
+    output->bCompiled = false;
+    output->Ret = MapTemplate(output->Src.c_str(), &output->pBuf, &output->Length, &output->SrcStatus, messages);
+    if (output->Ret == 0)
+    {
+        Stats.BytesRead += output->Length;
+        *fields |= TemplateFields(output->pBuf, output->Length);
+    }
+    StatsAddPhase(PHASE_READ, start);
+    return output->Ret;
+}
+
+// Compile the template in pBuf. With a cache directory the template is
+// compiled once and later runs find the compiled form by its content.
+static void CompileCached(const char * pBuf, size_t filelength, const char * cachedir, SubWcTemplate_t * tmpl)
+{
+    if (cachedir)
+    {
+        apr_uint64_t hash = HASH_INIT;
+        HashBytes(&hash, pBuf, filelength);
+        if (TemplateCacheLoad(cachedir, hash, filelength, tmpl))
+        {
+            Stats.TemplatesCached++;
+            return;
+        }
+        CompileTemplate(pBuf, filelength, tmpl);
+        TemplateCacheStore(cachedir, hash, filelength, tmpl);
+    }
+    else
+        CompileTemplate(pBuf, filelength, tmpl);
+}
+
+int SubWcContext::ExpandOutput(const SubWcOutput_t * output, const SubWCRev_t * SubStat,
+                               const char * cachedir, FILE * messages)
+{
+    if (output->Ret)
+        return output->Ret;
+
+    // now parse the filecontents for version defines.
+    apr_int64_t begin = StatsNow();
+    const char * pBuf = output->pBuf;
+    size_t filelength = output->Length;
+    std::string expanded;
+    SubWcTemplate_t tmpl;
+    const SubWcTemplate_t * compiled = NULL;
+    if (output->bCompiled)
+        compiled = &output->Compiled;
+    else if (cachedir)
+    {
+        CompileCached(pBuf, filelength, cachedir, &tmpl);
+        compiled = &tmpl;
+    }
+    if (!compiled || !ExpandCompiled(compiled, SubStat, expanded))
+        ExpandTemplate(pBuf, filelength, SubStat, expanded);
+    StatsAddPhase(PHASE_EXPAND, begin);
+
+    int ret = WriteVersionFile(output->Dst.c_str(), expanded, &output->SrcStatus, messages);
+    TraceSpan("template", "template", begin, StatsNow(), output->Src.c_str());
+    return ret;
+}
+
+int SubWcContext::TemplateFileFields(const char * src, unsigned * fields, FILE * messages)
+{
+    SubWcOutput_t output;
+    output.Src = src;
+    unsigned used = 0;
+    int ret = LoadTemplate(&output, &used, messages);
+    if (ret == 0)
+        *fields = used;
+    FreeTemplate(output.pBuf, output.Length);
+    return ret;
+}
+
+int SubWcContext::ExpandFile(const char * src, const char * dst, const SubWCRev_t * SubStat,
+                             const char * cachedir, FILE * messages)
+{
+    SubWcOutput_t output;
+    output.Src = src;
+    output.Dst = dst;
+    unsigned fields = 0;
+    int ret = LoadTemplate(&output, &fields, messages);
+    if (ret == 0)
+        ret = ExpandOutput(&output, SubStat, cachedir, messages);
+    FreeTemplate(output.pBuf, output.Length);
+    return ret;
+}
+
+// The absolute path of path in the UTF-8, internal style form the SVN and
+// wc.db functions take, or NULL if it cannot be converted.
+static const char * InternalPath(const char * path, apr_pool_t * pool)
+{
+    char * fullpath = realpath(path, NULL);
+    const char * utf8Path = NULL;
+    svn_error_t * svnerr = svn_utf_cstring_to_utf8(&utf8Path, fullpath ? fullpath : path, pool);
+    free(fullpath);
+    if (svnerr)
+    {
+        svn_error_clear(svnerr);
+        return NULL;
+    }
+    return svn_dirent_internal_style(utf8Path, pool);
+}
+
+// Appends path to a depfile rule, escaped the way Make reads it.
+// Returns FALSE for a path with a tab or a line break, or ending in a
+// backslash, which Make can not read back from a depfile.
+static bool AppendDepPath(std::string & out, const char * path)
+{
+    size_t len = strlen(path);
+    if (strpbrk(path, "\t\r\n") || (len && (path[len - 1] == '\\')))
+        return false;
+    for (const char * p = path; *p; ++p)
+    {
+        if (*p == '\\')
+        {
+            // a run of backslashes is literal, unless it is in front of
+            // an escaped character
+            size_t run = strspn(p, "\\");
+            out.append(strchr(" #:", p[run]) ? 2 * run : run, '\\');
+            p += run - 1;
+            continue;
+        }
+        if ((*p == ' ') || (*p == '#') || (*p == ':'))
+            out += '\\';
+        else if (*p == '$')
+            out += '$';
+        out += *p;
+    }
+    return true;
+}
+
+int SubWcContext::WriteDepfile(const char * depfile, const char * wc, const SubWCRev_t * SubStat, unsigned fields,
+                               const std::vector<std::pair<std::string, std::string> > & outputs, FILE * messages)
+{
+    SubWcClient_t client;
+    svn_error_t * svnerr = AcquireClient(&client);
+    if (svnerr)
+    {
+        svn_handle_error2(svnerr, messages, FALSE, "svnwcrev : ");
+        svn_error_clear(svnerr);
+        return ERR_SVN_ERR;
+    }
+    apr_pool_t * querypool;
+    apr_pool_create(&querypool, client.pool);
+
+    const char * internalpath = InternalPath(wc, querypool);
+    std::vector<std::string> deps;
+    bool bFound = internalpath &&
+                  WcDbDependencies(internalpath, SubStat->bExternals || SubStat->bExternalsNoMixedRevision,
+                                   (fields & WCF_MASK(WCF_MODS)) != 0, deps, querypool);
+    apr_pool_destroy(querypool);
+    ReleaseClient(&client);
+    if (!bFound)
+    {
+        fprintf(messages, "No wc.db found for '%s', depfile not written\n", wc);
+        return ERR_NOWC;
+    }
+    if (fields & (WCF_MASK(WCF_NOW) | WCF_MASK(WCF_UNVER)))
+        fprintf(messages, "The depfile does not track $WCNOW$ and $WCUNVER?...$\n");
+
+    std::string output;
+    const char * badpath = NULL;
+    for (std::vector<std::pair<std::string, std::string> >::const_iterator I = outputs.begin();
+         !badpath && (I != outputs.end()); ++I)
+    {
+        if (!AppendDepPath(output, I->first.c_str()))
+            badpath = I->first.c_str();
+        output += ": ";
+        if (!AppendDepPath(output, I->second.c_str()))
+            badpath = I->second.c_str();
+        for (std::vector<std::string>::const_iterator D = deps.begin(); !badpath && (D != deps.end()); ++D)
+        {
+            output += " \\\n  ";
+            if (!AppendDepPath(output, D->c_str()))
+                badpath = D->c_str();
+        }
+        output += '\n';
+    }
+    if (badpath)
+    {
+        // leaving the path out would hide a dependency from the build
+        fprintf(messages, "Path '%s' can not be listed in a depfile, depfile not written\n", badpath);
+        return ERR_READ;
+    }
+
+    // Written like the outputs: only if it changes, so the build does not
+    // see a new depfile on every run.
+    struct stat depStatus;
+    memset(&depStatus, 0, sizeof(depStatus));
+    depStatus.st_mode = 0644;
+    return WriteVersionFile(depfile, output, &depStatus, messages);
+}
+
+SubWcPrefetch::SubWcPrefetch(const char * wc, bool bExternals, std::vector<SubWcOutput_t> & outputs,
+                             const char * cachedir)
+    : WcPath(wc)
+    , bExternals(bExternals)
+    , Outputs(&outputs)
+    , CacheDir(cachedir)
+    , pool(NULL)
+    , thread(NULL)
+{
+    apr_pool_create_ex(&pool, NULL, abort_on_pool_failure, NULL);
+    if (apr_thread_create(&thread, NULL, Run, this, pool) != APR_SUCCESS)
+        thread = NULL;
+}
+
+SubWcPrefetch::~SubWcPrefetch()
+{
+    Wait();
+    apr_pool_destroy(pool);
+    for (std::vector<SubWcOutput_t>::iterator I = Outputs->begin(); I != Outputs->end(); ++I)
+    {
+        FreeTemplate(I->pBuf, I->Length);
+        I->pBuf = NULL;
+    }
+}
+
+void SubWcPrefetch::Wait()
+{
+    if (thread)
+    {
+        apr_status_t retval;
+        apr_thread_join(&retval, thread);
+        thread = NULL;
+    }
+}
+
+void * APR_THREAD_FUNC SubWcPrefetch::Run(apr_thread_t * thread, void * data)
+{
+    SubWcPrefetch * prefetch = (SubWcPrefetch *) data;
+    apr_int64_t start = StatsNow();
+    apr_pool_t * subpool = NULL;
+    apr_pool_create_ex(&subpool, NULL, abort_on_pool_failure, NULL);
+
+    // The crawl reads wc.db page by page, in no useful order; the first
+    // thing it needs is all of the database in memory.
+    const char * internalpath = InternalPath(prefetch->WcPath.c_str(), subpool);
+    std::vector<std::string> deps;
+    if (internalpath && WcDbDependencies(internalpath, prefetch->bExternals, false, deps, subpool))
+    {
+        for (std::vector<std::string>::const_iterator I = deps.begin(); I != deps.end(); ++I)
+            PrefetchFile(I->c_str());
+    }
+    apr_pool_destroy(subpool);
+
+    std::vector<SubWcOutput_t> & outputs = *prefetch->Outputs;
+    for (std::vector<SubWcOutput_t>::iterator I = outputs.begin(); I != outputs.end(); ++I)
+    {
+        if (I->Ret == 0)
+        {
+            CompileCached(I->pBuf, I->Length, prefetch->CacheDir, &I->Compiled);
+            I->bCompiled = true;
+        }
+    }
+    // The outputs are compared with the expanded templates through a
+    // mapping of their own, which then finds them in the page cache.
+    for (std::vector<SubWcOutput_t>::const_iterator I = outputs.begin(); I != outputs.end(); ++I)
+        PrefetchFile(I->Dst.c_str());
+    TraceSpan("prefetch", "io", start, StatsNow(), prefetch->WcPath.c_str());
+    apr_thread_exit(thread, APR_SUCCESS);
+    return NULL;
+}
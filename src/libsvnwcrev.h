@@ -0,0 +1,226 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_proc.h>
+#include "SVNWcRev.h"
+#include "cache.h"
+
+/**
+ * \ingroup SubWCRev
+ * What a query has to collect, besides the options in SubStat.
+ */
+typedef struct SubWcQuery_t
+{
+    unsigned Fields;            // WCF_MASK bits the templates need, ~0u if not known
+    bool bErrOnMods;            // the caller checks for local modifications (-n)
+    bool bErrOnMixed;           // the caller checks for mixed revisions (-m)
+    bool bComplete;             // the caller shows every field, the checks must not stop the crawl
+    const char * CacheDir;      // on-disk status cache, or NULL
+} SubWcQuery_t;
+
+/**
+ * \ingroup SubWCRev
+ * How a query got its answer.
+ */
+typedef struct SubWcQueryInfo_t
+{
+    const char * Source;        // "cache", "wc.db" or "status crawl"
+    unsigned Skip;              // SKIP_xxx: the parts of the crawl left out
+    bool bCacheHit;             // TRUE if the answer came from a cache
+} SubWcQueryInfo_t;
+
+/**
+ * \ingroup SubWCRev
+ * One working copy of a batch query.
+ */
+typedef struct SubWcBatchItem_t
+{
+    std::string Path;           // the working copy
+    SubWCRev_t SubStat;         // options in, collected information out
+    SubWcQueryInfo_t Info;
+    svn_error_t * Err;          // error of GetStatus(), to be cleared by the caller
+} SubWcBatchItem_t;
+
+/**
+ * \ingroup SubWCRev
+ * A template and the file expanded from it. The template is mapped once,
+ * before the query, and kept for the expansion; SubWcPrefetch compiles it
+ * and unmaps it when it is done.
+ */
+typedef struct SubWcOutput_t
+{
+    std::string Src;            // SrcVersionFile
+    std::string Dst;            // DstVersionFile
+    int Ret;                    // ERR_xxx of reading Src
+    const char * pBuf;          // Src, mapped; NULL if it could not be read
+    size_t Length;
+    struct stat SrcStatus;
+    SubWcTemplate_t Compiled;   // the template compiled, if bCompiled
+    bool bCompiled;
+} SubWcOutput_t;
+
+/**
+ * \ingroup SubWCRev
+ * One svn_client_ctx_t with the pool it lives in. A client serves one
+ * query at a time.
+ */
+typedef struct SubWcClient_t
+{
+    apr_pool_t * pool;
+    svn_client_ctx_t * ctx;
+} SubWcClient_t;
+
+/**
+ * \ingroup SubWCRev
+ * The APR/SVN state svnwcrev works with, set up once and used for any
+ * number of queries and template expansions.
+ *
+ * A context may be used from several threads at the same time. Each query
+ * gets a svn_client_ctx_t of its own, taken from a list of idle ones and
+ * returned afterwards, so the working copy handles are never shared
+ * between threads. Create and destroy contexts from one thread only.
+ */
+class SubWcContext
+{
+public:
+    /**
+     * Initializes APR and SVN and creates the first client. With
+     * bMemCache the results are remembered in memory and reused while
+     * the working copy is unchanged.
+     */
+    SubWcContext(bool bMemCache = false);
+    ~SubWcContext();
+
+    /**
+     * Collects the status of the working copy at path into SubStat. The
+     * options (bFolders, bExternals, bHexPlain, ...) must be set in
+     * SubStat already. info may be NULL. The returned error must be
+     * cleared by the caller.
+     */
+    svn_error_t * GetStatus(const char * path, const SubWcQuery_t * query,
+                            SubWCRev_t * SubStat, SubWcQueryInfo_t * info);
+
+    /**
+     * Runs GetStatus() for every item, on up to threads threads at the
+     * same time. Each item keeps its own result and error.
+     */
+    void GetStatusBatch(std::vector<SubWcBatchItem_t> & items, const SubWcQuery_t * query, int threads);
+
+    /**
+     * Maps the template output->Src and adds the WCF_MASK bits it uses to
+     * fields. Returns ERR_xxx, kept in output->Ret; problems are reported
+     * to messages.
+     */
+    int LoadTemplate(SubWcOutput_t * output, unsigned * fields, FILE * messages);
+
+    /**
+     * Expands the template of output, mapped by LoadTemplate(), with SubStat
+     * and writes the result to output->Dst, unless it has that content
+     * already. Returns ERR_xxx; problems are reported to messages, those
+     * of reading the template when it was read.
+     */
+    int ExpandOutput(const SubWcOutput_t * output, const SubWCRev_t * SubStat,
+                     const char * cachedir, FILE * messages);
+
+    /**
+     * Sets fields to the WCF_MASK bits used by the template file src.
+     * Returns ERR_xxx; problems are reported to messages.
+     */
+    int TemplateFileFields(const char * src, unsigned * fields, FILE * messages);
+
+    /**
+     * Expands the template file src with SubStat and writes the result to
+     * dst, unless dst has that content already. With cachedir the compiled
+     * template is kept there and reused while the template is unchanged.
+     * Returns ERR_xxx; problems are reported to messages.
+     */
+    int ExpandFile(const char * src, const char * dst, const SubWCRev_t * SubStat,
+                   const char * cachedir, FILE * messages);
+
+    /**
+     * Writes a depfile for Make or Ninja to depfile, unless it has that
+     * content already. Every output (DstVersionFile, SrcVersionFile) of
+     * outputs depends on its template, on the wc.db of the working copy
+     * at wc and, if SubStat crawls the externals, on theirs. With
+     * $WCMODS?...$ in fields (WCF_MASK bits) the versioned files are
+     * listed as well. A path with a tab or a line break, or ending in a
+     * backslash, can not be written and fails with ERR_READ. Returns
+     * ERR_xxx; problems are reported to messages.
+     */
+    int WriteDepfile(const char * depfile, const char * wc, const SubWCRev_t * SubStat, unsigned fields,
+                     const std::vector<std::pair<std::string, std::string> > & outputs, FILE * messages);
+
+    apr_int64_t StartNs;        // when the context was created, for --trace
+    apr_int64_t InitNs;         // time the APR/SVN initialization took, for --stats
+    apr_int64_t ContextNs;      // time svn_client_create_context took, for --stats
+
+private:
+    SubWcContext(const SubWcContext &);
+    SubWcContext & operator=(const SubWcContext &);
+
+    svn_error_t * AcquireClient(SubWcClient_t * client);
+    void ReleaseClient(const SubWcClient_t * client);
+
+    apr_pool_t * pool;
+    apr_thread_mutex_t * Lock;  // guards Clients
+    std::vector<SubWcClient_t> Clients;     // idle clients
+    SubWcMemCache_t * MemCache; // NULL without bMemCache
+};
+
+/**
+ * \ingroup SubWCRev
+ * Prepares what a run needs after the query on a thread of its own, while
+ * the working copy is crawled: reads the wc.db of the working copy and of
+ * its externals into the page cache, compiles the templates of the
+ * outputs and has the kernel read every Dst ahead. Without the thread
+ * everything is read when it is needed, as before.
+ */
+class SubWcPrefetch
+{
+public:
+    /**
+     * Starts the reads. The templates must have been read with
+     * SubWcContext::LoadTemplate(); outputs must not change until Wait()
+     * returns, and must outlive the prefetch, which unmaps the templates.
+     * With cachedir the compiled templates are kept there.
+     */
+    SubWcPrefetch(const char * wc, bool bExternals, std::vector<SubWcOutput_t> & outputs,
+                  const char * cachedir);
+    ~SubWcPrefetch();
+
+    /** Waits for the reads to finish. */
+    void Wait();
+
+private:
+    SubWcPrefetch(const SubWcPrefetch &);
+    SubWcPrefetch & operator=(const SubWcPrefetch &);
+
+    static void * APR_THREAD_FUNC Run(apr_thread_t * thread, void * data);
+
+    std::string WcPath;
+    bool bExternals;
+    std::vector<SubWcOutput_t> * Outputs;
+    const char * CacheDir;
+    apr_pool_t * pool;          // the thread lives in it
+    apr_thread_t * thread;      // NULL when done
+};
@@ -0,0 +1,317 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
+#include "stats.h"
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+SubWcStats_t Stats;
+
+static apr_pool_t * StatsPool = NULL;
+static apr_thread_mutex_t * StatsMutex = NULL;
+
+static const char * PhaseNames[PHASE_COUNT] =
+{
+    "init",
+    "context",
+    "read",
+    "cache",
+    "wcdb",
+    "crawl",
+    "root",
+    "externals",
+    "verify",
+    "expand",
+    "write"
+};
+
+static apr_status_t StatsCleanup(void *)
+{
+    StatsPool = NULL;
+    StatsMutex = NULL;
+    return APR_SUCCESS;
+}
+
+void StatsInit()
+{
+    if (StatsPool)
+        return;
+    // not owned by any context; goes away with apr_terminate()
+    if (apr_pool_create(&StatsPool, NULL) != APR_SUCCESS)
+    {
+        StatsPool = NULL;
+        return;
+    }
+    apr_pool_cleanup_register(StatsPool, NULL, StatsCleanup, apr_pool_cleanup_null);
+    if (apr_thread_mutex_create(&StatsMutex, APR_THREAD_MUTEX_DEFAULT, StatsPool) != APR_SUCCESS)
+        StatsMutex = NULL;
+}
+
+// Resident memory right now. Unlike getrusage() this can go down again,
+// so a long-running daemon still gets the high-water mark of each run.
+static apr_uint64_t CurrentRssKb()
+{
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if (fd == -1)
+        return 0;
+    char buf[128];
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return 0;
+    buf[len] = 0;
+    unsigned long long size = 0, resident = 0;
+    if (sscanf(buf, "%llu %llu", &size, &resident) != 2)
+        return 0;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// The malloc heap in use; the APR allocators get their blocks from it.
+static apr_uint64_t CurrentHeapKb()
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (info.uordblks + info.hblkhd) / 1024;
+#else
+    return 0;
+#endif
+}
+
+static void AddTraceCounter(apr_uint64_t rss, apr_uint64_t heap);
+
+// Update the high-water marks; the caller holds the lock.
+static void SampleMemory()
+{
+    apr_uint64_t rss = CurrentRssKb();
+    apr_uint64_t heap = CurrentHeapKb();
+    if (rss > Stats.RssHighWaterKb)
+        Stats.RssHighWaterKb = rss;
+    if (heap > Stats.HeapHighWaterKb)
+        Stats.HeapHighWaterKb = heap;
+    if (Stats.bTrace)
+        AddTraceCounter(rss, heap);
+}
+
+void StatsReset()
+{
+    if (StatsMutex)
+        apr_thread_mutex_lock(StatsMutex);
+    for (int i = 0; i < PHASE_COUNT; ++i)
+        Stats.PhaseNs[i] = 0;
+    Stats.Nodes = 0;
+    Stats.ExternalsProps = 0;
+    Stats.PropLookups = 0;
+    Stats.Externals = 0;
+    Stats.Shards = 0;
+    Stats.Suspects = 0;
+    Stats.Compared = 0;
+    Stats.BytesRead = 0;
+    Stats.BytesWritten = 0;
+    Stats.FilesRewritten = 0;
+    Stats.FilesUnchanged = 0;
+    Stats.TemplatesCached = 0;
+    Stats.RssStartKb = CurrentRssKb();
+    Stats.RssHighWaterKb = Stats.RssStartKb;
+    Stats.HeapHighWaterKb = CurrentHeapKb();
+    Stats.ExternalNs.clear();
+    Stats.bTrace = false;
+    Stats.TraceEvents.clear();
+    if (StatsMutex)
+        apr_thread_mutex_unlock(StatsMutex);
+}
+
+apr_int64_t StatsNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (apr_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void AppendJsonString(std::string & out, const char * str)
+{
+    out += '"';
+    for (const unsigned char * p = (const unsigned char *)str; *p; ++p)
+    {
+        if ((*p == '"') || (*p == '\\'))
+        {
+            out += '\\';
+            out += *p;
+        }
+        else if (*p < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+            out += escaped;
+        }
+        else
+            out += *p;
+    }
+    out += '"';
+}
+
+static void WriteJsonString(FILE * out, const char * str)
+{
+    std::string json;
+    AppendJsonString(json, str);
+    fputs(json.c_str(), out);
+}
+
+// Build a complete ("X") trace event; the caller holds the lock.
+static void AddTraceEvent(const char * name, const char * category, apr_int64_t start, apr_int64_t elapsed,
+                          const char * detail, const char * revision)
+{
+    char numbers[128];
+    std::string event = "{\"name\": ";
+    AppendJsonString(event, name);
+    event += ", \"cat\": ";
+    AppendJsonString(event, category);
+    snprintf(numbers, sizeof(numbers), ", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %ld, \"tid\": %ld",
+             start / 1e3, elapsed / 1e3, (long)getpid(), (long)syscall(SYS_gettid));
+    event += numbers;
+    if (detail || revision)
+    {
+        event += ", \"args\": {";
+        if (detail)
+        {
+            event += "\"path\": ";
+            AppendJsonString(event, detail);
+        }
+        if (revision)
+        {
+            event += detail ? ", \"revision\": " : "\"revision\": ";
+            AppendJsonString(event, revision);
+        }
+        event += "}";
+    }
+    event += "}";
+    Stats.TraceEvents.push_back(event);
+}
+
+// Build a counter ("C") trace event with the memory in use; the caller
+// holds the lock.
+static void AddTraceCounter(apr_uint64_t rss, apr_uint64_t heap)
+{
+    char event[192];
+    snprintf(event, sizeof(event),
+             "{\"name\": \"memory\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %ld, "
+             "\"args\": {\"rss_kb\": %llu, \"heap_kb\": %llu}}",
+             StatsNow() / 1e3, (long)getpid(), (unsigned long long)rss, (unsigned long long)heap);
+    Stats.TraceEvents.push_back(event);
+}
+
+void StatsSampleMemory()
+{
+    if (StatsMutex)
+        apr_thread_mutex_lock(StatsMutex);
+    SampleMemory();
+    if (StatsMutex)
+        apr_thread_mutex_unlock(StatsMutex);
+}
+
+void StatsAddPhase(SubWcPhase_t phase, apr_int64_t start)
+{
+    apr_int64_t elapsed = StatsNow() - start;
+    if (StatsMutex)
+        apr_thread_mutex_lock(StatsMutex);
+    Stats.PhaseNs[phase] += elapsed;
+    if (Stats.bTrace)
+        AddTraceEvent(PhaseNames[phase], "phase", start, elapsed, NULL, NULL);
+    SampleMemory();
+    if (StatsMutex)
+        apr_thread_mutex_unlock(StatsMutex);
+}
+
+void StatsAddExternal(const char * path, const char * revision, apr_int64_t start)
+{
+    apr_int64_t elapsed = StatsNow() - start;
+    if (StatsMutex)
+        apr_thread_mutex_lock(StatsMutex);
+    Stats.ExternalNs.push_back(std::make_pair(std::string(path), elapsed));
+    if (Stats.bTrace)
+    {
+        const char * name = strrchr(path, '/');
+        AddTraceEvent(name ? name + 1 : path, "external", start, elapsed, path, revision);
+    }
+    SampleMemory();
+    if (StatsMutex)
+        apr_thread_mutex_unlock(StatsMutex);
+}
+
+void TraceSpan(const char * name, const char * category, apr_int64_t start, apr_int64_t end, const char * detail)
+{
+    if (!Stats.bTrace)
+        return;
+    if (StatsMutex)
+        apr_thread_mutex_lock(StatsMutex);
+    AddTraceEvent(name, category, start, end - start, detail, NULL);
+    if (StatsMutex)
+        apr_thread_mutex_unlock(StatsMutex);
+}
+
+bool TraceWrite(const char * file)
+{
+    FILE * out = fopen(file, "w");
+    if (out == NULL)
+        return false;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (size_t i = 0; i < Stats.TraceEvents.size(); ++i)
+        fprintf(out, "%s\n%s", i ? "," : "", Stats.TraceEvents[i].c_str());
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
+
+void StatsWriteJson(FILE * out)
+{
+    fprintf(out, "{\n  \"phases_ms\": {");
+    for (int i = 0; i < PHASE_COUNT; ++i)
+        fprintf(out, "%s\n    \"%s\": %.3f", i ? "," : "", PhaseNames[i], Stats.PhaseNs[i] / 1e6);
+    fprintf(out, "\n  },\n  \"externals_ms\": [");
+    for (size_t i = 0; i < Stats.ExternalNs.size(); ++i)
+    {
+        fprintf(out, "%s\n    { \"path\": ", i ? "," : "");
+        WriteJsonString(out, Stats.ExternalNs[i].first.c_str());
+        fprintf(out, ", \"ms\": %.3f }", Stats.ExternalNs[i].second / 1e6);
+    }
+    fprintf(out, "%s],\n", Stats.ExternalNs.empty() ? "" : "\n  ");
+    fprintf(out, "  \"nodes\": %u,\n", Stats.Nodes);
+    fprintf(out, "  \"externals_props\": %u,\n", Stats.ExternalsProps);
+    fprintf(out, "  \"prop_lookups\": %u,\n", Stats.PropLookups);
+    fprintf(out, "  \"externals\": %u,\n", Stats.Externals);
+    fprintf(out, "  \"shards\": %u,\n", Stats.Shards);
+    fprintf(out, "  \"suspects\": %u,\n", Stats.Suspects);
+    fprintf(out, "  \"compared\": %u,\n", Stats.Compared);
+    fprintf(out, "  \"bytes_read\": %llu,\n", (unsigned long long)Stats.BytesRead);
+    fprintf(out, "  \"bytes_written\": %llu,\n", (unsigned long long)Stats.BytesWritten);
+    fprintf(out, "  \"files_rewritten\": %u,\n", Stats.FilesRewritten);
+    fprintf(out, "  \"files_unchanged\": %u,\n", Stats.FilesUnchanged);
+    fprintf(out, "  \"templates_cached\": %u,\n", Stats.TemplatesCached);
+    struct rusage usage;
+    long peak = (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+    fprintf(out, "  \"memory_kb\": {\n");
+    fprintf(out, "    \"rss_start\": %llu,\n", (unsigned long long)Stats.RssStartKb);
+    fprintf(out, "    \"rss_high_water\": %llu,\n", (unsigned long long)Stats.RssHighWaterKb);
+    fprintf(out, "    \"heap_high_water\": %llu,\n", (unsigned long long)Stats.HeapHighWaterKb);
+    fprintf(out, "    \"process_peak_rss\": %ld\n  },\n", peak);
+    fprintf(out, "  \"output_rewritten\": %s\n}\n", Stats.FilesRewritten ? "true" : "false");
+}
@@ -0,0 +1,137 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <apr_pools.h>
+
+/**
+ * \ingroup SubWCRev
+ * The phases of a run which are timed for --stats.
+ */
+typedef enum SubWcPhase_t
+{
+    PHASE_INIT,         // apr_initialize, svn_dso_initialize2
+    PHASE_CONTEXT,      // svn_client_create_context
+    PHASE_READ,         // reading the templates and finding their placeholders
+    PHASE_CACHE,        // fingerprint and cache lookup
+    PHASE_WCDB,         // revisions from wc.db
+    PHASE_CRAWL,        // svn_status, including the externals
+    PHASE_ROOT,         // the extra work for the crawl roots (getfirststatus)
+    PHASE_EXTERNALS,    // crawling the externals
+    PHASE_VERIFY,       // checking the files for text modifications after the crawl
+    PHASE_EXPAND,       // template expansion
+    PHASE_WRITE,        // comparing and writing the output files
+    PHASE_COUNT
+} SubWcPhase_t;
+
+/**
+ * \ingroup SubWCRev
+ * Timings and counters of one run. The counters are updated atomically,
+ * since externals are crawled by several threads.
+ */
+typedef struct SubWcStats_t
+{
+    apr_int64_t PhaseNs[PHASE_COUNT];           // time spent per phase
+    volatile apr_uint32_t Nodes;                // nodes reported by the crawls
+    volatile apr_uint32_t ExternalsProps;       // directories whose svn:externals were fetched
+    volatile apr_uint32_t PropLookups;          // svn_wc_prop_get2 calls
+    volatile apr_uint32_t Externals;            // externals crawled
+    volatile apr_uint32_t Shards;               // directories crawled apart from the rest of their working copy
+    volatile apr_uint32_t Suspects;             // files whose size or timestamp differs from wc.db
+    volatile apr_uint32_t Compared;             // suspect files compared with their pristine copies
+    apr_uint64_t BytesRead;                     // template bytes read
+    apr_uint64_t BytesWritten;                  // output bytes written
+    unsigned FilesRewritten;                    // outputs whose content changed
+    unsigned FilesUnchanged;                    // outputs left alone
+    unsigned TemplatesCached;                   // templates whose compiled form came from the cache
+    apr_uint64_t RssStartKb;                    // resident memory when the run started
+    apr_uint64_t RssHighWaterKb;                // highest resident memory sampled during the run
+    apr_uint64_t HeapHighWaterKb;               // highest malloc heap in use sampled, pools included
+    std::vector<std::pair<std::string, apr_int64_t> > ExternalNs;  // time per external
+    bool bTrace;                                // record trace events for --trace
+    std::vector<std::string> TraceEvents;       // the recorded events as JSON objects
+} SubWcStats_t;
+
+extern SubWcStats_t Stats;
+
+/**
+ * \ingroup SubWCRev
+ * Sets up the lock used by StatsAddPhase() and StatsAddExternal(). Called
+ * after apr_initialize(), before any crawl; later calls do nothing.
+ * The statistics are per process: with several queries running at the
+ * same time they add up, and the plain counters are only approximate.
+ */
+void StatsInit();
+
+/**
+ * \ingroup SubWCRev
+ * Clears the statistics for a new run. Safe while other queries run,
+ * though their counts then mix with those of the new run.
+ */
+void StatsReset();
+
+/**
+ * \ingroup SubWCRev
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+apr_int64_t StatsNow();
+
+/**
+ * \ingroup SubWCRev
+ * Adds the time since start, taken with StatsNow(), to phase, and traces
+ * it as a span if Stats.bTrace is set.
+ */
+void StatsAddPhase(SubWcPhase_t phase, apr_int64_t start);
+
+/**
+ * \ingroup SubWCRev
+ * Records the time since start it took to crawl the external at path,
+ * pinned to revision ("HEAD" if it is not pinned).
+ */
+void StatsAddExternal(const char * path, const char * revision, apr_int64_t start);
+
+/**
+ * \ingroup SubWCRev
+ * Samples the resident memory and the heap in use for the high-water
+ * marks; traced as counters if Stats.bTrace is set. Also done by
+ * StatsAddPhase() and StatsAddExternal().
+ */
+void StatsSampleMemory();
+
+/**
+ * \ingroup SubWCRev
+ * Records a trace event for --trace: a span called name from start to
+ * end, both taken with StatsNow(). detail, if not NULL, is shown as the
+ * path of the span. Does nothing unless Stats.bTrace is set.
+ */
+void TraceSpan(const char * name, const char * category, apr_int64_t start, apr_int64_t end, const char * detail);
+
+/**
+ * \ingroup SubWCRev
+ * Writes the recorded trace events to file in the Chrome trace event
+ * format, which chrome://tracing and Perfetto load directly.
+ */
+bool TraceWrite(const char * file);
+
+/**
+ * \ingroup SubWCRev
+ * Writes the statistics as a JSON object to out.
+ */
+void StatsWriteJson(FILE * out);
@@ -23,34 +23,64 @@
 #include "svn_dirent_uri.h"
 #include "svn_utf.h"
 #include "svn_props.h"
+#include <apr_thread_proc.h>
+#include <apr_atomic.h>
+#include <apr_time.h>
 #pragma warning(pop)
 #include "SVNWcRev.h"
+#include "stats.h"
+#include "wcdb.h"
 #include <string>
 #include <algorithm>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #pragma warning(push)
 #pragma warning(disable:4127)   //conditional expression is constant (cause of SVN_ERR)
 
+// The value of every character as a hex digit, -1 if it is none.
+static const struct HexDigits_t
+{
+    signed char Value[256];
+    HexDigits_t()
+    {
+        memset(Value, -1, sizeof(Value));
+        for (int i = 0; i < 10; ++i)
+            Value['0' + i] = (signed char) i;
+        for (int i = 0; i < 6; ++i)
+        {
+            Value['A' + i] = (signed char) (10 + i);
+            Value['a' + i] = (signed char) (10 + i);
+        }
+    }
+} HexDigits;
+
 // Copy the URL from src to dest, unescaping on the fly.
 void UnescapeCopy(const char * root, const char * src, char * dest, int buf_len)
 {
     const char * pszSource = root;
     char * pszDest = dest;
-    int len = 0;
-
-    // under VS.NET2k5 strchr() wants this to be a non-const array :/
-
-    static char szHex[] = "0123456789ABCDEF";
-
-    // Unescape special characters. The number of characters
-    // in the *pszDest is assumed to be <= the number of characters
-    // in pszSource (they are both the same string anyway)
+    // Every character or escape sequence of the source counts, and so
+    // does the '/' between root and src.
+    int left = buf_len - 1;
 
     bool bRoot = true;
-    while ((*pszSource != '\0') && (++len < buf_len))
+    while ((*pszSource != '\0') && (left > 0))
     {
-        if (*pszSource == '%')
+        if (*pszSource != '%')
+        {
+            // the characters up to the next escape are copied in one go
+            size_t run = strcspn(pszSource, "%");
+            if (run > (size_t)left)
+                run = left;
+            memcpy(pszDest, pszSource, run);
+            pszDest += run;
+            pszSource += run;
+            left -= (int)run;
+        }
+        else
         {
             // The next two chars following '%' should be digits
             if ( *(pszSource + 1) == '\0' ||
@@ -60,36 +90,30 @@ void UnescapeCopy(const char * root, const char * src, char * dest, int buf_len)
                 break;
             }
 
+            // A bad first digit gives '?' and is skipped, a bad second
+            // digit gives '?' and is skipped together with the first.
             char nValue = '?';
-            char * pszLow = NULL;
-            char * pszHigh = NULL;
             pszSource++;
-
-            char up = (char) toupper(*pszSource);
-            pszHigh = strchr(szHex, up);
-
-            if (pszHigh != NULL)
+            int high = HexDigits.Value[(unsigned char) *pszSource];
+            if (high >= 0)
             {
                 pszSource++;
-                up = (char) toupper(*pszSource);
-                pszLow = strchr(szHex, up);
-
-                if (pszLow != NULL)
-                {
-                    nValue = (char) (((pszHigh - szHex) << 4) +
-                        (pszLow - szHex));
-                }
+                int low = HexDigits.Value[(unsigned char) *pszSource];
+                if (low >= 0)
+                    nValue = (char) ((high << 4) + low);
             }
             *pszDest++ = nValue;
+            pszSource++;
+            --left;
         }
-        else
-            *pszDest++ = *pszSource;
 
-        pszSource++;
         if ((bRoot)&&(*pszSource == 0))
         {
-            if (*pszDest != '/')
+            if ((*pszDest != '/')&&(left > 0))
+            {
                 *pszDest++ = '/';
+                --left;
+            }
             pszSource = src;
             bRoot = false;
         }
@@ -165,7 +189,7 @@ bool IsTaggedVersion(const char * url)
     return isTag;
 }
 
-svn_error_t * getfirststatus(void * baton, const char * path, const svn_client_status_t * status, apr_pool_t * pool)
+svn_error_t * getfirststatus(void * baton, const char * path, const svn_wc_status3_t * status, apr_pool_t * pool)
 {
     SubWCRev_StatusBaton_t * sb = (SubWCRev_StatusBaton_t *) baton;
     if((NULL == status) || (NULL == sb) || (NULL == sb->SubStat))
@@ -176,10 +200,16 @@ svn_error_t * getfirststatus(void * baton, const char * path, const svn_client_s
     {
         UnescapeCopy(status->repos_root_url, status->repos_relpath, sb->SubStat->Url, URL_BUF);
         sb->SubStat->bIsTagged = IsTaggedVersion(sb->SubStat->Url);
+        if (status->repos_root_url)
+        {
+            sb->UrlRoot = apr_pstrdup(sb->pool, status->repos_root_url);
+            sb->UrlRelpath = apr_pstrdup(sb->pool, status->repos_relpath);
+        }
     }
-    if (status->kind == svn_node_file)
+    if ((status->kind == svn_node_file) && !(sb->SubStat->Skip & SKIP_NEEDS_LOCK))
     {
         const svn_string_t * value = NULL;
+        apr_atomic_inc32(&Stats.PropLookups);
         svn_error_t * e = svn_wc_prop_get2(&value, sb->wc_ctx, path, "svn:needs-lock", pool, pool);
         if (e == NULL)
             sb->SubStat->LockData.NeedsLocks = (value != 0);
@@ -188,12 +218,78 @@ svn_error_t * getfirststatus(void * baton, const char * path, const svn_client_s
             sb->SubStat->LockData.NeedsLocks = false;
             svn_error_clear(e);
         }
+        sb->SubStat->bNeedsLockSeen = true;
     }
 
     return SVN_NO_ERROR;
 }
 
-svn_error_t * getallstatus(void * baton, const char * path, const svn_client_status_t * status, apr_pool_t * pool)
+void InitStatusBaton(SubWCRev_StatusBaton_t * sb, SubWCRev_t * SubStat, apr_pool_t * pool)
+{
+    sb->SubStat = SubStat;
+    sb->extarray = NULL;
+    sb->pool = pool;
+    sb->wc_ctx = NULL;
+    sb->RootPath = NULL;
+    sb->UrlRoot = NULL;
+    sb->UrlRelpath = NULL;
+    sb->bItemSeen = false;
+    sb->IsLocked = false;
+    sb->LockDate = 0;
+    sb->LockOwner.clear();
+    sb->LockComment.clear();
+}
+
+void FlushStatusBaton(SubWCRev_StatusBaton_t * sb)
+{
+    if (!sb->bItemSeen)
+        return;
+    SubWcLockData_t * LockData = &sb->SubStat->LockData;
+    LockData->IsLocked = sb->IsLocked;
+    if (sb->IsLocked)
+    {
+        strncpy(LockData->Owner, sb->LockOwner.c_str(), OWNER_BUF - 1);
+        LockData->Owner[OWNER_BUF - 1] = 0;
+        strncpy(LockData->Comment, sb->LockComment.c_str(), COMMENT_BUF - 1);
+        LockData->Comment[COMMENT_BUF - 1] = 0;
+        LockData->CreationDate = sb->LockDate;
+    }
+    else
+    {
+        LockData->Owner[0] = 0;
+        LockData->Comment[0] = 0;
+        LockData->CreationDate = 0;
+    }
+}
+
+// True if the URL made of root and relpath is the one of the working copy.
+static bool IsWcUrl(const SubWCRev_StatusBaton_t * sb, const char * root, const char * relpath)
+{
+    if ((sb->UrlRelpath != NULL) && (strcmp(root, sb->UrlRoot) == 0))
+    {
+        if (strcmp(relpath, sb->UrlRelpath) == 0)
+            return true;
+        // With the same root, different relpaths unescape to different
+        // URLs, unless an escape sequence spells a character differently
+        // or the URLs are cut off at URL_BUF.
+        if ((strchr(relpath, '%') == NULL) && (strchr(sb->UrlRelpath, '%') == NULL) &&
+            (strlen(root) + std::max(strlen(relpath), strlen(sb->UrlRelpath)) < URL_BUF - 2))
+            return false;
+    }
+    char EntryUrl[URL_BUF];
+    UnescapeCopy(root, relpath, EntryUrl, URL_BUF);
+    return strncmp(sb->SubStat->Url, EntryUrl, URL_BUF) == 0;
+}
+
+// True once nothing the crawl could still find changes the outcome of
+// the -n and -m checks.
+static bool IsAnswerFixed(const SubWCRev_t * SubStat)
+{
+    return (SubStat->bStopOnMods && SubStat->HasMods) ||
+           (SubStat->bStopOnMixed && (SubStat->MinRev != SubStat->MaxRev));
+}
+
+svn_error_t * getallstatus(void * baton, const char * path, const svn_wc_status3_t * status, apr_pool_t * pool)
 {
     SubWCRev_StatusBaton_t * sb = (SubWCRev_StatusBaton_t *) baton;
     if((NULL == status) || (NULL == sb) || (NULL == sb->SubStat))
@@ -201,9 +297,25 @@ svn_error_t * getallstatus(void * baton, const char * path, const svn_client_sta
         return SVN_NO_ERROR;
     }
 
-    if (status->kind == svn_node_dir)
+    // The root of the crawl gets the extra treatment which used to need
+    // a separate svn_depth_empty pass.
+    // Big crawls sample the memory now and then, for the high-water mark.
+    if ((apr_atomic_inc32(&Stats.Nodes) & 0xfff) == 0xfff)
+        StatsSampleMemory();
+    if ((sb->RootPath != NULL) && (strcmp(path, sb->RootPath) == 0))
+    {
+        apr_int64_t start = StatsNow();
+        svn_error_t * err = getfirststatus(baton, path, status, pool);
+        StatsAddPhase(PHASE_ROOT, start);
+        SVN_ERR(err);
+    }
+
+    // svn:externals is only looked at if the externals are crawled as well
+    if ((status->kind == svn_node_dir) && (sb->extarray != NULL))
     {
         const svn_string_t * value = NULL;
+        apr_atomic_inc32(&Stats.PropLookups);
+        apr_atomic_inc32(&Stats.ExternalsProps);
         svn_wc_prop_get2(&value, sb->wc_ctx, path, "svn:externals", pool, pool);
         if (value)
         {
@@ -223,7 +335,6 @@ svn_error_t * getallstatus(void * baton, const char * path, const svn_client_sta
                             sb->SubStat->bIsExternalsNotFixed = TRUE;
                         }
 
-                        if (((sb->SubStat->bExternals) || (sb->SubStat->bExternalsNoMixedRevision)) && (NULL != sb->extarray))
                         {
                             SubWcExtData_t extdata;
                             extdata.Path = apr_pstrcat(sb->pool, path, "/", e->target_dir, NULL);
@@ -233,6 +344,7 @@ svn_error_t * getallstatus(void * baton, const char * path, const svn_client_sta
                     }
                 }
             }
+            svn_error_clear(err);
         }
     }
 
@@ -249,9 +361,7 @@ svn_error_t * getallstatus(void * baton, const char * path, const svn_client_sta
     {
         if ((sb->SubStat->Author[0] == 0)&&(status->repos_relpath)&&(status->repos_root_url))
         {
-            char EntryUrl[URL_BUF];
-            UnescapeCopy(status->repos_root_url, status->repos_relpath,EntryUrl, URL_BUF);
-            if (strncmp(sb->SubStat->Url, EntryUrl, URL_BUF) == 0)
+            if (IsWcUrl(sb, status->repos_root_url, status->repos_relpath))
             {
                 strncpy(sb->SubStat->Author, status->changed_author, URL_BUF);
             }
@@ -274,6 +384,7 @@ svn_error_t * getallstatus(void * baton, const char * path, const svn_client_sta
         sb->SubStat->MinRev = status->revision;
     }
 
+    sb->SubStat->bItemSeen = true;
     sb->SubStat->bIsSvnItem = false;
     switch (status->node_status)
     {
@@ -311,27 +422,599 @@ svn_error_t * getallstatus(void * baton, const char * path, const svn_client_sta
         break;
     }
 
-    // Assign the values for the lock information
-    sb->SubStat->LockData.IsLocked = false;
-    strcpy(sb->SubStat->LockData.Owner, "");
-    strcpy(sb->SubStat->LockData.Comment, "");
-    sb->SubStat->LockData.CreationDate = 0;
-
+    // Only the lock of the last node ends up in the result, so the strings
+    // are not copied for every node, only when a lock differs from the one
+    // before.
+    sb->bItemSeen = true;
+    sb->IsLocked = false;
     if ((status->lock)&&(status->lock->token))
     {
         if((status->lock->token[0] != 0))
         {
-            sb->SubStat->LockData.IsLocked = true;
-            if(NULL != status->lock->owner)
-                strncpy(sb->SubStat->LockData.Owner, status->lock->owner, OWNER_BUF);
-            if(NULL != status->lock->comment)
-                strncpy(sb->SubStat->LockData.Comment, status->lock->comment, COMMENT_BUF);
-            sb->SubStat->LockData.CreationDate = status->lock->creation_date;
+            sb->IsLocked = true;
+            const char * owner = status->lock->owner ? status->lock->owner : "";
+            const char * comment = status->lock->comment ? status->lock->comment : "";
+            if (sb->LockOwner.compare(owner) != 0)
+                sb->LockOwner.assign(owner);
+            if (sb->LockComment.compare(comment) != 0)
+                sb->LockComment.assign(comment);
+            sb->LockDate = status->lock->creation_date;
         }
     }
+
+    if (IsAnswerFixed(sb->SubStat))
+    {
+        sb->SubStat->bStopped = true;
+        return svn_error_create(SVN_ERR_CEASE_INVOCATION, NULL, NULL);
+    }
     return SVN_NO_ERROR;
 }
 
+// Prepare the result of an external crawl: the options and the strings
+// which decide what is collected are taken over from the parent.
+static void InitExternalStat(SubWCRev_t * ExtStat, const SubWCRev_t * SubStat)
+{
+    memset(ExtStat, 0, sizeof(SubWCRev_t));
+    ExtStat->bFolders = SubStat->bFolders;
+    ExtStat->bExternals = SubStat->bExternals;
+    ExtStat->bExternalsNoMixedRevision = SubStat->bExternalsNoMixedRevision;
+    ExtStat->bHexPlain = SubStat->bHexPlain;
+    ExtStat->bHexX = SubStat->bHexX;
+    ExtStat->Threads = 1;   // nested externals are crawled by the same worker
+    ExtStat->bStopOnMods = SubStat->bStopOnMods;
+    ExtStat->bStopOnMixed = SubStat->bStopOnMixed;
+    ExtStat->Skip = SubStat->Skip;
+    ExtStat->Depth = SubStat->Depth + 1;
+    strncpy(ExtStat->Url, SubStat->Url, URL_BUF);
+    strncpy(ExtStat->RootUrl, SubStat->RootUrl, URL_BUF);
+    strncpy(ExtStat->Author, SubStat->Author, URL_BUF);
+    ExtStat->bIsTagged = SubStat->bIsTagged;
+}
+
+// Widen the revision range of SubStat by the one of PartStat.
+static void MergeRevisions(SubWCRev_t * SubStat, const SubWCRev_t * PartStat)
+{
+    if (SubStat->MaxRev < PartStat->MaxRev)
+    {
+        SubStat->MaxRev = PartStat->MaxRev;
+    }
+    if ((PartStat->MinRev > 0)&&(SubStat->MinRev > PartStat->MinRev || SubStat->MinRev == 0))
+    {
+        SubStat->MinRev = PartStat->MinRev;
+    }
+}
+
+// Fold the result of a crawl which followed the one of SubStat into it,
+// everything but the revision range. The result is the same as if the
+// crawls had collected into SubStat one after the other.
+static void MergeStat(SubWCRev_t * SubStat, const SubWCRev_t * PartStat)
+{
+    if (SubStat->CmtRev < PartStat->CmtRev)
+    {
+        SubStat->CmtRev = PartStat->CmtRev;
+        SubStat->CmtDate = PartStat->CmtDate;
+    }
+    SubStat->HasMods |= PartStat->HasMods;
+    SubStat->HasUnversioned |= PartStat->HasUnversioned;
+    SubStat->bIsExternalsNotFixed |= PartStat->bIsExternalsNotFixed;
+    SubStat->bIsExternalMixed |= PartStat->bIsExternalMixed;
+    SubStat->bStopped |= PartStat->bStopped;
+    if (SubStat->RootUrl[0] == 0)
+        strncpy(SubStat->RootUrl, PartStat->RootUrl, URL_BUF);
+    if (SubStat->Url[0] == 0)
+    {
+        strncpy(SubStat->Url, PartStat->Url, URL_BUF);
+        SubStat->bIsTagged = PartStat->bIsTagged;
+    }
+    if (SubStat->Author[0] == 0)
+        strncpy(SubStat->Author, PartStat->Author, URL_BUF);
+    // the item information is the one of the last node crawled
+    if (PartStat->bItemSeen)
+    {
+        bool NeedsLocks = SubStat->LockData.NeedsLocks;
+        SubStat->bIsSvnItem = PartStat->bIsSvnItem;
+        SubStat->LockData = PartStat->LockData;
+        SubStat->LockData.NeedsLocks = NeedsLocks;
+        SubStat->bItemSeen = true;
+    }
+    if (PartStat->bNeedsLockSeen)
+    {
+        SubStat->LockData.NeedsLocks = PartStat->LockData.NeedsLocks;
+        SubStat->bNeedsLockSeen = true;
+    }
+}
+
+// Fold the result of an external crawl into the parent result. Merging the
+// externals in the order they were found gives the same result as
+// crawling them one after the other into the parent.
+static void MergeExternalStat(SubWCRev_t * SubStat, const SubWcExtData_t * extdata, const SubWCRev_t * ExtStat)
+{
+    bool bFixed = SubStat->bExternalsNoMixedRevision && (extdata->Revision.kind == svn_opt_revision_number);
+    // Check if the used revsions are only same as the external explicit revision
+    if (!bFixed || (extdata->Revision.value.number != ExtStat->MaxRev) || (extdata->Revision.value.number != ExtStat->MinRev))
+    {
+        MergeRevisions(SubStat, ExtStat);
+        // Set an extra variable, because when an fixed external has been manually updated to head, no error occour.
+        if (bFixed)
+            SubStat->bIsExternalMixed = TRUE;
+    }
+    MergeStat(SubStat, ExtStat);
+}
+
+// The revision an external is pinned to, as shown in the statistics.
+static const char * PinnedRevision(const svn_opt_revision_t * revision, char * buf, size_t len)
+{
+    if (revision->kind == svn_opt_revision_number)
+    {
+        snprintf(buf, len, "%ld", (long)revision->value.number);
+        return buf;
+    }
+    if (revision->kind == svn_opt_revision_date)
+        return "date";
+    return "HEAD";
+}
+
+// Work shared by the threads crawling externals.
+typedef struct SubWcExtWork_t
+{
+    std::vector<SubWcExtResult_t> * results;
+    volatile apr_uint32_t next;     // index of the next external to crawl
+    volatile bool stop;             // an external decided the -n/-m checks
+    svn_boolean_t no_ignore;
+} SubWcExtWork_t;
+
+// Crawl externals from the work list until it is empty.
+static void crawlexternallist(SubWcExtWork_t * work, svn_client_ctx_t * ctx, apr_pool_t * pool)
+{
+    apr_pool_t * iterpool = NULL;
+    apr_pool_create(&iterpool, pool);
+    for (;;)
+    {
+        apr_uint32_t i = apr_atomic_inc32(&work->next);
+        if ((i >= work->results->size()) || work->stop)
+            break;
+        SubWcExtResult_t & result = (*work->results)[i];
+        apr_pool_clear(iterpool);
+        apr_int64_t start = StatsNow();
+        svn_error_clear(svn_status(result.Ext.Path, &result.SubStat, work->no_ignore, ctx, iterpool));
+        char revbuf[32];
+        StatsAddExternal(result.Ext.Path, PinnedRevision(&result.Ext.Revision, revbuf, sizeof(revbuf)), start);
+        apr_atomic_inc32(&Stats.Externals);
+        if (result.SubStat.bStopped)
+            work->stop = true;
+    }
+    apr_pool_destroy(iterpool);
+}
+
+static void * APR_THREAD_FUNC crawlexternals(apr_thread_t * thread, void * data)
+{
+    SubWcExtWork_t * work = (SubWcExtWork_t *) data;
+
+    // Every worker has its own pool and client context, so nothing
+    // but the result slots is shared between the threads.
+    apr_pool_t * pool = NULL;
+    apr_pool_create_ex(&pool, NULL, NULL, NULL);
+    svn_client_ctx_t * ctx = NULL;
+    svn_error_t * err = svn_client_create_context(&ctx, pool);
+    if (err == NULL)
+        crawlexternallist(work, ctx, pool);
+    svn_error_clear(err);
+    apr_pool_destroy(pool);
+    apr_thread_exit(thread, APR_SUCCESS);
+    return NULL;
+}
+
+// One part of a sharded crawl: a directory below the root, crawled by a
+// walk of its own, or a run of the other nodes the listing of the root
+// reported, between two such directories.
+typedef struct SubWcShard_t
+{
+    const char * Path;          // the directory, NULL for a run of nodes
+    std::vector<std::pair<const char *, const svn_wc_status3_t *> > Nodes;  // the run
+    SubWCRev_t SubStat;
+    std::vector<SubWcExtData_t> Externals;  // externals found, their paths in pool
+    apr_pool_t * pool;          // NULL until the shard is crawled
+    svn_error_t * Err;
+} SubWcShard_t;
+
+// Baton of listchildren().
+typedef struct SubWcChildren_t
+{
+    const char * RootPath;
+    std::vector<SubWcShard_t> * shards;
+    apr_pool_t * pool;          // holds the listed nodes
+    bool bSplit;                // FALSE if the crawl cannot be split
+} SubWcChildren_t;
+
+// Splits the nodes of a svn_depth_immediates walk of the root into shards.
+// Only directories whose walk reports the same nodes as the walk of the
+// whole working copy does below them become shards of their own: those
+// which are in the working copy as they are. Unversioned directories and
+// externals are not walked into anyway; added, deleted, missing, ...
+// directories leave the crawl unsplit.
+static svn_error_t * listchildren(void * baton, const char * path, const svn_wc_status3_t * status, apr_pool_t * /*pool*/)
+{
+    SubWcChildren_t * children = (SubWcChildren_t *) baton;
+    std::vector<SubWcShard_t> * shards = children->shards;
+    if (shards->empty() && (strcmp(path, children->RootPath) != 0))
+        children->bSplit = false;
+    if ((status->kind == svn_node_dir) && status->versioned && !shards->empty() &&
+        (status->node_status != svn_wc_status_external))
+    {
+        if ((status->node_status != svn_wc_status_normal) && (status->node_status != svn_wc_status_modified))
+            children->bSplit = false;
+        else
+        {
+            shards->push_back(SubWcShard_t());
+            shards->back().Path = apr_pstrdup(children->pool, path);
+            return SVN_NO_ERROR;
+        }
+    }
+    if (!children->bSplit)
+        return svn_error_create(SVN_ERR_CEASE_INVOCATION, NULL, NULL);
+    if (shards->empty() || shards->back().Path)
+    {
+        shards->push_back(SubWcShard_t());
+        shards->back().Path = NULL;
+    }
+    shards->back().Nodes.push_back(std::make_pair(apr_pstrdup(children->pool, path),
+                                                  svn_wc_dup_status3(status, children->pool)));
+    return SVN_NO_ERROR;
+}
+
+// Work shared by the threads crawling shards.
+typedef struct SubWcShardWork_t
+{
+    std::vector<SubWcShard_t> * shards;
+    volatile apr_uint32_t next;     // index of the next shard to crawl
+    volatile bool stop;             // a shard decided the -n/-m checks or failed
+    const SubWCRev_StatusBaton_t * sb;  // the baton of the root
+    svn_boolean_t no_ignore;
+    svn_boolean_t ignore_text_mods;
+    const apr_array_header_t * ignore_patterns;
+    svn_cancel_func_t cancel_func;
+    void * cancel_baton;
+} SubWcShardWork_t;
+
+// Cancels the walks of the other shards once one has stopped.
+static svn_error_t * cancelshard(void * baton)
+{
+    SubWcShardWork_t * work = (SubWcShardWork_t *) baton;
+    if (work->stop)
+        return svn_error_create(SVN_ERR_CANCELLED, NULL, NULL);
+    if (work->cancel_func)
+        return work->cancel_func(work->cancel_baton);
+    return SVN_NO_ERROR;
+}
+
+// Crawl shards from the work list until it is empty.
+static void crawlshardlist(SubWcShardWork_t * work, svn_wc_context_t * wc_ctx, apr_pool_t * pool)
+{
+    apr_pool_t * iterpool = NULL;
+    apr_pool_create(&iterpool, pool);
+    for (;;)
+    {
+        apr_uint32_t i = apr_atomic_inc32(&work->next);
+        if ((i >= work->shards->size()) || work->stop)
+            break;
+        SubWcShard_t & shard = (*work->shards)[i];
+        apr_pool_clear(iterpool);
+        // The shard's pool outlives the thread, it is destroyed after
+        // the merge.
+        apr_pool_create_ex(&shard.pool, NULL, NULL, NULL);
+
+        SubWCRev_StatusBaton_t sb;
+        InitStatusBaton(&sb, &shard.SubStat, shard.pool);
+        sb.extarray = work->sb->extarray ? &shard.Externals : NULL;
+        sb.wc_ctx = wc_ctx;
+        sb.UrlRoot = work->sb->UrlRoot;
+        sb.UrlRelpath = work->sb->UrlRelpath;
+
+        svn_error_t * err = NULL;
+        if (shard.Path)
+        {
+            apr_int64_t start = StatsNow();
+            err = svn_wc_walk_status(wc_ctx, shard.Path, svn_depth_infinity, TRUE, work->no_ignore,
+                                     work->ignore_text_mods, work->ignore_patterns,
+                                     getallstatus, &sb, cancelshard, work, iterpool);
+            TraceSpan("svn_wc_walk_status", "crawl", start, StatsNow(), shard.Path);
+            apr_atomic_inc32(&Stats.Shards);
+        }
+        else
+        {
+            for (size_t n = 0; (n < shard.Nodes.size()) && (err == NULL); ++n)
+                err = getallstatus(&sb, shard.Nodes[n].first, shard.Nodes[n].second, iterpool);
+        }
+        FlushStatusBaton(&sb);
+        if (shard.SubStat.bStopped || work->stop)
+        {
+            // stopped by itself or cancelled because another one stopped
+            svn_error_clear(err);
+            err = NULL;
+            shard.SubStat.bStopped = true;
+        }
+        shard.Err = err;
+        if (shard.SubStat.bStopped || err)
+            work->stop = true;
+    }
+    apr_pool_destroy(iterpool);
+}
+
+static void * APR_THREAD_FUNC crawlshards(apr_thread_t * thread, void * data)
+{
+    SubWcShardWork_t * work = (SubWcShardWork_t *) data;
+
+    // Every worker has its own pool and working copy context, so the
+    // working copy database is never used by two threads at once.
+    apr_pool_t * pool = NULL;
+    apr_pool_create_ex(&pool, NULL, NULL, NULL);
+    svn_wc_context_t * wc_ctx = NULL;
+    svn_error_t * err = svn_wc_context_create(&wc_ctx, NULL, pool, pool);
+    if (err == NULL)
+        crawlshardlist(work, wc_ctx, pool);
+    svn_error_clear(err);
+    apr_pool_destroy(pool);
+    apr_thread_exit(thread, APR_SUCCESS);
+    return NULL;
+}
+
+// Crawls the working copy at abspath in shards, on up to SubStat->Threads
+// threads: the directories right below the root are walked at the same
+// time and the results are merged in the order a single walk reports
+// them in, which gives the result of that walk. Returns FALSE, with sb
+// left alone, if the working copy is not worth splitting or cannot be
+// split; then the caller walks it as a whole.
+static bool CrawlShards(SubWCRev_StatusBaton_t * sb, const char * abspath, svn_boolean_t no_ignore,
+                        svn_boolean_t ignore_text_mods, const apr_array_header_t * ignore_patterns,
+                        svn_client_ctx_t * ctx, apr_pool_t * pool, svn_error_t ** err)
+{
+    SubWCRev_t * SubStat = sb->SubStat;
+    if (SubStat->Threads < 2)
+        return false;
+
+    std::vector<SubWcShard_t> shards;
+    SubWcChildren_t children;
+    children.RootPath = abspath;
+    children.shards = &shards;
+    children.pool = pool;
+    children.bSplit = true;
+    apr_int64_t start = StatsNow();
+    svn_error_t * e = svn_wc_walk_status(ctx->wc_ctx, abspath, svn_depth_immediates, TRUE, no_ignore,
+                                         ignore_text_mods, ignore_patterns,
+                                         listchildren, &children, ctx->cancel_func, ctx->cancel_baton, pool);
+    TraceSpan("list children", "crawl", start, StatsNow(), abspath);
+    int dirs = 0;
+    for (size_t i = 0; i < shards.size(); ++i)
+        dirs += (shards[i].Path != NULL);
+    // The strings the shards need are known after the root only if it
+    // has a repository root URL.
+    if (e || !children.bSplit || (dirs < 2) ||
+        (shards[0].Nodes[0].second->repos_root_url == NULL))
+    {
+        svn_error_clear(e);
+        return false;
+    }
+
+    // The root and the nodes up to the first directory go to sb right
+    // away; the other shards start with the URLs and the author found.
+    // If a shard fails, sb is put back and the caller's walk of the whole
+    // working copy reports the error as it always did.
+    SubWCRev_t * saved = new SubWCRev_t;
+    memcpy(saved, SubStat, sizeof(SubWCRev_t));
+    SubWCRev_StatusBaton_t savedsb = *sb;
+    *err = NULL;
+    for (size_t n = 0; (n < shards[0].Nodes.size()) && (*err == NULL); ++n)
+        *err = getallstatus(sb, shards[0].Nodes[n].first, shards[0].Nodes[n].second, pool);
+    FlushStatusBaton(sb);
+    if (*err || SubStat->bStopped)
+    {
+        delete saved;
+        return true;
+    }
+
+    for (size_t i = 1; i < shards.size(); ++i)
+    {
+        InitExternalStat(&shards[i].SubStat, SubStat);
+        shards[i].SubStat.Depth = SubStat->Depth;
+        shards[i].pool = NULL;
+        shards[i].Err = NULL;
+    }
+
+    SubWcShardWork_t work;
+    work.shards = &shards;
+    work.next = 1;
+    work.stop = false;
+    work.sb = sb;
+    work.no_ignore = no_ignore;
+    work.ignore_text_mods = ignore_text_mods;
+    work.ignore_patterns = ignore_patterns;
+    work.cancel_func = ctx->cancel_func;
+    work.cancel_baton = ctx->cancel_baton;
+    // this thread crawls as well
+    int threads = std::min<int>(SubStat->Threads, dirs);
+    std::vector<apr_thread_t *> workers;
+    for (int i = 1; i < threads; ++i)
+    {
+        apr_thread_t * thread = NULL;
+        if (apr_thread_create(&thread, NULL, crawlshards, &work, pool) == APR_SUCCESS)
+            workers.push_back(thread);
+    }
+    crawlshardlist(&work, ctx->wc_ctx, pool);
+    for (std::vector<apr_thread_t *>::iterator I = workers.begin(); I != workers.end(); ++I)
+    {
+        apr_status_t retval;
+        apr_thread_join(&retval, *I);
+    }
+
+    bool bFailed = false;
+    for (size_t i = 1; i < shards.size(); ++i)
+    {
+        bFailed |= (shards[i].Err != NULL);
+        svn_error_clear(shards[i].Err);
+    }
+    // Shards after one which stopped the crawl may not have been
+    // crawled; by then the answer is fixed anyway.
+    for (size_t i = 1; (i < shards.size()) && !bFailed; ++i)
+    {
+        if (shards[i].pool == NULL)
+        {
+            SubStat->bStopped = true;
+            break;
+        }
+        MergeRevisions(SubStat, &shards[i].SubStat);
+        MergeStat(SubStat, &shards[i].SubStat);
+        for (std::vector<SubWcExtData_t>::iterator I = shards[i].Externals.begin(); I != shards[i].Externals.end(); ++I)
+        {
+            SubWcExtData_t extdata = *I;
+            extdata.Path = apr_pstrdup(sb->pool, I->Path);
+            sb->extarray->push_back(extdata);
+        }
+        if (IsAnswerFixed(SubStat))
+        {
+            SubStat->bStopped = true;
+            break;
+        }
+    }
+    for (size_t i = 1; i < shards.size(); ++i)
+    {
+        if (shards[i].pool)
+            apr_pool_destroy(shards[i].pool);
+    }
+    if (bFailed)
+    {
+        memcpy(SubStat, saved, sizeof(SubWCRev_t));
+        *sb = savedsb;
+        if (sb->extarray)
+            sb->extarray->clear();
+    }
+    delete saved;
+    return !bFailed;
+}
+
+// Files checked by a worker at a time
+#define VERIFY_CHUNK    64
+
+// Work shared by the threads checking files for text modifications.
+typedef struct SubWcVerifyWork_t
+{
+    const std::vector<SubWcDbFile_t> * files;
+    volatile apr_uint32_t next;     // index of the next chunk of files
+    volatile bool modified;         // a file was found modified
+    bool bCompare;                  // compare the suspect files, else they count as modified
+} SubWcVerifyWork_t;
+
+void PrefetchFile(const char * path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+// Check files from the work list until it is empty or one is modified.
+// A file whose size and timestamp are what wc.db recorded is unmodified,
+// as svn status takes it; the others are suspect and compared with their
+// pristine copies by svn_wc_text_modified_p2(), which does the
+// translation of keywords and line endings as well.
+static void verifyfilelist(SubWcVerifyWork_t * work, svn_wc_context_t * wc_ctx, apr_pool_t * pool)
+{
+    apr_pool_t * iterpool = NULL;
+    apr_pool_create(&iterpool, pool);
+    const std::vector<SubWcDbFile_t> & files = *work->files;
+    for (;;)
+    {
+        apr_uint32_t begin = apr_atomic_add32(&work->next, VERIFY_CHUNK);
+        if ((begin >= files.size()) || work->modified)
+            break;
+        size_t end = std::min<size_t>(begin + VERIFY_CHUNK, files.size());
+        for (size_t i = begin; (i < end) && !work->modified; ++i)
+        {
+            const SubWcDbFile_t & file = files[i];
+            struct stat st;
+            if (lstat(file.Path.c_str(), &st) != 0)
+            {
+                // gone since the crawl saw it
+                work->modified = true;
+                break;
+            }
+            apr_time_t mtime = (apr_time_t)st.st_mtim.tv_sec * APR_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000;
+            if (((file.Size < 0) || (file.Size == st.st_size)) && (file.ModTime == mtime))
+                continue;
+            apr_atomic_inc32(&Stats.Suspects);
+            if (!work->bCompare && (file.Size >= 0) && (file.ModTime != 0))
+            {
+                work->modified = true;
+                break;
+            }
+
+            apr_atomic_inc32(&Stats.Compared);
+            apr_pool_clear(iterpool);
+            // the comparison reads the files in small requests
+            PrefetchFile(file.Path.c_str());
+            if (!file.Pristine.empty())
+                PrefetchFile(file.Pristine.c_str());
+            svn_boolean_t modified = TRUE;
+            svn_error_t * err = svn_wc_text_modified_p2(&modified, wc_ctx, file.Path.c_str(), FALSE, iterpool);
+            if (err)
+            {
+                // not known to be unmodified
+                svn_error_clear(err);
+                modified = TRUE;
+            }
+            if (modified)
+                work->modified = true;
+        }
+    }
+    apr_pool_destroy(iterpool);
+}
+
+static void * APR_THREAD_FUNC verifyfiles(apr_thread_t * thread, void * data)
+{
+    SubWcVerifyWork_t * work = (SubWcVerifyWork_t *) data;
+
+    apr_pool_t * pool = NULL;
+    apr_pool_create_ex(&pool, NULL, NULL, NULL);
+    svn_wc_context_t * wc_ctx = NULL;
+    svn_error_t * err = svn_wc_context_create(&wc_ctx, NULL, pool, pool);
+    if (err == NULL)
+        verifyfilelist(work, wc_ctx, pool);
+    svn_error_clear(err);
+    apr_pool_destroy(pool);
+    apr_thread_exit(thread, APR_SUCCESS);
+    return NULL;
+}
+
+// Returns TRUE if one of files has text modifications, checked on up to
+// threads threads. Without bCompare, a file whose size or timestamp
+// differs from the recorded one counts as modified without being read.
+static bool VerifyFiles(const std::vector<SubWcDbFile_t> & files, bool bCompare, int threads,
+                        svn_client_ctx_t * ctx, apr_pool_t * pool)
+{
+    SubWcVerifyWork_t work;
+    work.files = &files;
+    work.next = 0;
+    work.modified = false;
+    work.bCompare = bCompare;
+    // this thread checks files as well
+    threads = std::min<int>(threads, (int)((files.size() + VERIFY_CHUNK - 1) / VERIFY_CHUNK));
+    std::vector<apr_thread_t *> workers;
+    for (int i = 1; i < threads; ++i)
+    {
+        apr_thread_t * thread = NULL;
+        if (apr_thread_create(&thread, NULL, verifyfiles, &work, pool) == APR_SUCCESS)
+            workers.push_back(thread);
+    }
+    verifyfilelist(&work, ctx->wc_ctx, pool);
+    for (std::vector<apr_thread_t *>::iterator I = workers.begin(); I != workers.end(); ++I)
+    {
+        apr_status_t retval;
+        apr_thread_join(&retval, *I);
+    }
+    return work.modified;
+}
+
 svn_error_t *
 svn_status (    const char *path,
                 void *status_baton,
@@ -339,65 +1022,156 @@ svn_status (    const char *path,
                 svn_client_ctx_t *ctx,
                 apr_pool_t *pool)
 {
+    const char * abspath = NULL;
+    SVN_ERR(svn_dirent_get_absolute(&abspath, path, pool));
+
+    // Only the paths of the externals outlive the walk; they stay in
+    // extpool until the externals are crawled. Whatever else the walk
+    // allocates is freed with walkpool right after it.
+    apr_pool_t * extpool = NULL;
+    apr_pool_create(&extpool, pool);
+    apr_pool_t * walkpool = NULL;
+    apr_pool_create(&walkpool, pool);
+
     SubWCRev_StatusBaton_t sb;
-    std::vector<SubWcExtData_t> * extarray = new std::vector<SubWcExtData_t>;
-    sb.SubStat = (SubWCRev_t *)status_baton;
+    InitStatusBaton(&sb, (SubWCRev_t *)status_baton, extpool);
+    std::vector<SubWcExtData_t> * extarray = NULL;
+    if (sb.SubStat->bExternals || sb.SubStat->bExternalsNoMixedRevision)
+        extarray = new std::vector<SubWcExtData_t>;
     sb.extarray = extarray;
-    sb.pool = pool;
     sb.wc_ctx = ctx->wc_ctx;
+    sb.RootPath = abspath;
 
-    svn_opt_revision_t wcrev;
-    wcrev.kind = svn_opt_revision_working;
+    // Unversioned items are not reported at all if every name is ignored.
+    apr_array_header_t * ignore_patterns = NULL;
+    if (sb.SubStat->Skip & SKIP_UNVERSIONED)
+    {
+        no_ignore = FALSE;
+        ignore_patterns = apr_array_make(walkpool, 1, sizeof(const char *));
+        APR_ARRAY_PUSH(ignore_patterns, const char *) = "*";
+    }
 
-    SVN_ERR(svn_client_status5(NULL, ctx, path, &wcrev, svn_depth_empty, true, false, true, true, true, NULL, getfirststatus, &sb, pool));
-    SVN_ERR(svn_client_status5(NULL, ctx, path, &wcrev, svn_depth_infinity, true, false, true, true, true, NULL, getallstatus, &sb, pool));
+    // The walk compares the files one after the other. With more threads,
+    // or with timestamps trusted, it leaves the files alone instead, and
+    // the files wc.db lists are checked after it, if the walk found no
+    // modification already.
+    std::vector<SubWcDbFile_t> files;
+    bool bVerify = !(sb.SubStat->Skip & SKIP_TEXT_MODS) &&
+                   ((sb.SubStat->Skip & SKIP_TEXT_COMPARE) || (sb.SubStat->Threads > 1)) &&
+                   WcDbListFiles(abspath, files, walkpool);
+    svn_boolean_t ignore_text_mods = bVerify || (sb.SubStat->Skip & SKIP_TEXT_MODS);
+
+    svn_error_t * err = NULL;
+    if (!CrawlShards(&sb, abspath, no_ignore, ignore_text_mods, ignore_patterns, ctx, walkpool, &err))
+    {
+        apr_int64_t walkstart = StatsNow();
+        err = svn_wc_walk_status(ctx->wc_ctx, abspath, svn_depth_infinity, TRUE, no_ignore,
+                                 ignore_text_mods, ignore_patterns,
+                                 getallstatus, &sb, ctx->cancel_func, ctx->cancel_baton, walkpool);
+        TraceSpan("svn_wc_walk_status", "crawl", walkstart, StatsNow(), abspath);
+        FlushStatusBaton(&sb);
+    }
+    apr_pool_destroy(walkpool);
+    if (sb.SubStat->bStopped)
+    {
+        // getallstatus ceased the crawl, the answer is known
+        svn_error_clear(err);
+        err = NULL;
+    }
+    if (bVerify && !err && !sb.SubStat->bStopped && !sb.SubStat->HasMods)
+    {
+        apr_int64_t start = StatsNow();
+        sb.SubStat->HasMods = VerifyFiles(files, !(sb.SubStat->Skip & SKIP_TEXT_COMPARE),
+                                          sb.SubStat->Threads, ctx, pool);
+        StatsAddPhase(PHASE_VERIFY, start);
+        if (IsAnswerFixed(sb.SubStat))
+            sb.SubStat->bStopped = true;
+    }
+    std::vector<SubWcDbFile_t>().swap(files);
+    if (err || sb.SubStat->bStopped || (extarray == NULL))
+    {
+        delete extarray;
+        apr_pool_destroy(extpool);
+        return err;
+    }
 
     // now crawl through all externals
+    std::vector<SubWcExtResult_t> results;
     for (std::vector<SubWcExtData_t>::iterator I = extarray->begin(); I != extarray->end(); ++I)
     {
-        SubWcExtData_t extdata = *I;
-        svn_revnum_t minRev = -1;
-        svn_revnum_t maxRev = -1;
-        if (strcmp(path, extdata.Path))
+        if (strcmp(abspath, I->Path))
         {
-            if (sb.SubStat->bExternalsNoMixedRevision && (extdata.Revision.kind == svn_opt_revision_number))
-            {
-                minRev = sb.SubStat->MinRev;
-                maxRev = sb.SubStat->MaxRev;
-                sb.SubStat->MinRev = 0;
-                sb.SubStat->MaxRev = 0;
-            }
+            results.push_back(SubWcExtResult_t());
+            results.back().Ext = *I;
+        }
+    }
+    delete extarray;
 
-            svn_status (extdata.Path, sb.SubStat, no_ignore, ctx, pool);
+    // nested externals are part of the time of their parent external
+    apr_int64_t start = StatsNow();
+    int threads = std::min<int>(sb.SubStat->Threads, (int)results.size());
+    if (threads > 1)
+    {
+        for (std::vector<SubWcExtResult_t>::iterator I = results.begin(); I != results.end(); ++I)
+            InitExternalStat(&I->SubStat, sb.SubStat);
 
-            if (sb.SubStat->bExternalsNoMixedRevision && (extdata.Revision.kind == svn_opt_revision_number))
+        SubWcExtWork_t work;
+        work.results = &results;
+        work.next = 0;
+        work.no_ignore = no_ignore;
+        work.stop = false;
+        std::vector<apr_thread_t *> workers;
+        for (int i = 0; i < threads; ++i)
+        {
+            apr_thread_t * thread = NULL;
+            if (apr_thread_create(&thread, NULL, crawlexternals, &work, pool) == APR_SUCCESS)
+                workers.push_back(thread);
+        }
+        if (workers.empty())
+            crawlexternallist(&work, ctx, pool);
+        for (std::vector<apr_thread_t *>::iterator I = workers.begin(); I != workers.end(); ++I)
+        {
+            apr_status_t retval;
+            apr_thread_join(&retval, *I);
+        }
+        // Externals after the one which stopped the crawl may not have
+        // been crawled; by then the answer is fixed anyway.
+        for (std::vector<SubWcExtResult_t>::iterator I = results.begin(); I != results.end(); ++I)
+        {
+            MergeExternalStat(sb.SubStat, &I->Ext, &I->SubStat);
+            if (IsAnswerFixed(sb.SubStat))
             {
-                // Check if the used revsions are only same as the external explicit revision
-                if ((extdata.Revision.value.number == sb.SubStat->MaxRev) && (extdata.Revision.value.number == sb.SubStat->MinRev))
-                {
-                    sb.SubStat->MaxRev = maxRev;
-                    sb.SubStat->MinRev = minRev;
-                }
-                else
-                {
-                    if (sb.SubStat->MaxRev < maxRev)
-                    {
-                        sb.SubStat->MaxRev = maxRev;
-                    }
-                    if ((minRev > 0)&&(sb.SubStat->MinRev > minRev || sb.SubStat->MinRev == 0))
-                    {
-                        sb.SubStat->MinRev = minRev;
-                    }
-                    // Set an extra variable, because when an fixed external has been manually updated to head, no error occour.
-                    sb.SubStat->bIsExternalMixed = TRUE;
-                }
+                sb.SubStat->bStopped = true;
+                break;
             }
         }
     }
-
-    delete extarray;
+    else
+    {
+        apr_pool_t * iterpool = NULL;
+        apr_pool_create(&iterpool, pool);
+        for (std::vector<SubWcExtResult_t>::iterator I = results.begin(); I != results.end(); ++I)
+        {
+            apr_pool_clear(iterpool);
+            InitExternalStat(&I->SubStat, sb.SubStat);
+            apr_int64_t start = StatsNow();
+            svn_error_clear(svn_status(I->Ext.Path, &I->SubStat, no_ignore, ctx, iterpool));
+            char revbuf[32];
+            StatsAddExternal(I->Ext.Path, PinnedRevision(&I->Ext.Revision, revbuf, sizeof(revbuf)), start);
+            apr_atomic_inc32(&Stats.Externals);
+            MergeExternalStat(sb.SubStat, &I->Ext, &I->SubStat);
+            if (IsAnswerFixed(sb.SubStat))
+            {
+                sb.SubStat->bStopped = true;
+                break;
+            }
+        }
+        apr_pool_destroy(iterpool);
+    }
+    apr_pool_destroy(extpool);
+    if (sb.SubStat->Depth == 0)
+        StatsAddPhase(PHASE_EXTERNALS, start);
 
     return SVN_NO_ERROR;
 }
 #pragma warning(pop)
-
@@ -0,0 +1,660 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <apr_time.h>
+#include "template.h"
+#include <string.h>
+#include <stdio.h>
+
+typedef enum SubWcPlaceholderKind_t
+{
+    PH_REVISION,    // replaced with a revision number or range
+    PH_DATE,        // replaced with a formatted date
+    PH_TEXT,        // replaced with a string (URL, lock owner...)
+    PH_BOOLEAN      // $WCxxx?TrueText:FalseText$
+} SubWcPlaceholderKind_t;
+
+typedef struct SubWcPlaceholder_t
+{
+    const char * Def;               // the placeholder text
+    size_t DefLen;                  // strlen(Def)
+    SubWcPlaceholderKind_t Kind;
+    SubWcField_t Field;             // the value the placeholder is replaced with
+} SubWcPlaceholder_t;
+
+#define PLACEHOLDER(def, kind, field) { def, sizeof(def) - 1, kind, field }
+
+// All known placeholders. The order of this table is the order in which
+// the placeholders used to be replaced one after the other, which decides
+// the result if two placeholders overlap.
+static const SubWcPlaceholder_t Placeholders[] =
+{
+    PLACEHOLDER("$WCREV$",          PH_REVISION,    WCF_REV),
+    PLACEHOLDER("$WCRANGE$",        PH_REVISION,    WCF_RANGE),
+    PLACEHOLDER("$WCDATE$",         PH_DATE,        WCF_DATE),
+    PLACEHOLDER("$WCDATEUTC$",      PH_DATE,        WCF_DATE),
+    PLACEHOLDER("$WCDATE=",         PH_DATE,        WCF_DATE),
+    PLACEHOLDER("$WCDATEUTC=",      PH_DATE,        WCF_DATE),
+    PLACEHOLDER("$WCNOW$",          PH_DATE,        WCF_NOW),
+    PLACEHOLDER("$WCNOWUTC$",       PH_DATE,        WCF_NOW),
+    PLACEHOLDER("$WCNOW=",          PH_DATE,        WCF_NOW),
+    PLACEHOLDER("$WCNOWUTC=",       PH_DATE,        WCF_NOW),
+    PLACEHOLDER("$WCMODS?",         PH_BOOLEAN,     WCF_MODS),
+    PLACEHOLDER("$WCMIXED?",        PH_BOOLEAN,     WCF_MIXED),
+    PLACEHOLDER("$WCURL$",          PH_TEXT,        WCF_URL),
+    PLACEHOLDER("$WCINSVN?",        PH_BOOLEAN,     WCF_INSVN),
+    PLACEHOLDER("$WCNEEDSLOCK?",    PH_BOOLEAN,     WCF_NEEDSLOCK),
+    PLACEHOLDER("$WCISLOCKED?",     PH_BOOLEAN,     WCF_ISLOCKED),
+    PLACEHOLDER("$WCLOCKDATE$",     PH_DATE,        WCF_LOCKDATE),
+    PLACEHOLDER("$WCLOCKDATEUTC$",  PH_DATE,        WCF_LOCKDATE),
+    PLACEHOLDER("$WCLOCKDATE=",     PH_DATE,        WCF_LOCKDATE),
+    PLACEHOLDER("$WCLOCKDATEUTC=",  PH_DATE,        WCF_LOCKDATE),
+    PLACEHOLDER("$WCLOCKOWNER$",    PH_TEXT,        WCF_LOCKOWNER),
+    PLACEHOLDER("$WCLOCKCOMMENT$",  PH_TEXT,        WCF_LOCKCOMMENT),
+    PLACEHOLDER("$WCUNVER?",        PH_BOOLEAN,     WCF_UNVER),
+};
+
+#define PLACEHOLDER_COUNT ((int)(sizeof(Placeholders) / sizeof(Placeholders[0])))
+
+// State of one template expansion.
+typedef struct SubWcExpand_t
+{
+    const char * pBuf;
+    size_t filelength;
+    const SubWCRev_t * SubStat;
+    size_t DisabledAt[PLACEHOLDER_COUNT];   // first malformed occurrence of a placeholder
+} SubWcExpand_t;
+
+static bool ExpandPlaceholder(SubWcExpand_t * ex, int id, size_t index,
+                              std::string & value, size_t & next);
+
+// Returns the index into Placeholders[] of the placeholder starting at
+// index, or -1 if there is none.
+static int MatchPlaceholder(const SubWcExpand_t * ex, size_t index)
+{
+    const char * p = ex->pBuf + index;
+    size_t left = ex->filelength - index;
+    if ((left < 4) || (p[1] != 'W') || (p[2] != 'C'))
+        return -1;
+    for (int i = 0; i < PLACEHOLDER_COUNT; ++i)
+    {
+        const SubWcPlaceholder_t & ph = Placeholders[i];
+        if ((ph.Def[3] == p[3]) && (ph.DefLen <= left) && (memcmp(p, ph.Def, ph.DefLen) == 0))
+            return i;
+    }
+    return -1;
+}
+
+static void DisablePlaceholder(SubWcExpand_t * ex, int id, size_t index)
+{
+    if (index < ex->DisabledAt[id])
+        ex->DisabledAt[id] = index;
+}
+
+static void FormatRevision(std::string & value, long MinRev, long MaxRev, const SubWCRev_t * SubStat)
+{
+    char destbuf[40];
+    if (MinRev == -1 || MinRev == MaxRev)
+    {
+        if ((SubStat)&&(SubStat->bHexPlain))
+            sprintf(destbuf, "%LX", (apr_int64_t)MaxRev);
+        else if ((SubStat)&&(SubStat->bHexX))
+            sprintf(destbuf, "%#LX", (apr_int64_t)MaxRev);
+        else
+            sprintf(destbuf, "%Ld", (apr_int64_t)MaxRev);
+    }
+    else
+    {
+        if ((SubStat)&&(SubStat->bHexPlain))
+            sprintf(destbuf, "%LX:%LX", (apr_int64_t)MinRev, (apr_int64_t)MaxRev);
+        else if ((SubStat)&&(SubStat->bHexX))
+            sprintf(destbuf, "%#LX:%#LX", (apr_int64_t)MinRev, (apr_int64_t)MaxRev);
+        else
+            sprintf(destbuf, "%Ld:%Ld", (apr_int64_t)MinRev, (apr_int64_t)MaxRev);
+    }
+    value.assign(destbuf);
+}
+
+static bool FormatDate(std::string & value, apr_time_t date_svn)
+{
+    apr_time_exp_t newtime;
+    apr_status_t status = apr_time_exp_lt(&newtime, date_svn);
+    if (status)
+        return false;
+
+    // Format the date/time in international format as yyyy/mm/dd hh:mm:ss
+    char destbuf[32];
+    sprintf(destbuf, "%04d/%02d/%02d %02d:%02d:%02d",
+            newtime.tm_year + 1900,
+            newtime.tm_mon + 1,
+            newtime.tm_mday,
+            newtime.tm_hour,
+            newtime.tm_min,
+            newtime.tm_sec);
+    value.assign(destbuf);
+    return true;
+}
+
+static bool GetBoolean(const SubWCRev_t * SubStat, SubWcField_t field)
+{
+    switch (field)
+    {
+    case WCF_MODS:      return SubStat->HasMods;
+    case WCF_MIXED:     return SubStat->MinRev != SubStat->MaxRev;
+    case WCF_INSVN:     return SubStat->bIsSvnItem;
+    case WCF_NEEDSLOCK: return SubStat->LockData.NeedsLocks;
+    case WCF_ISLOCKED:  return SubStat->LockData.IsLocked;
+    case WCF_UNVER:     return SubStat->HasUnversioned;
+    default:            return false;
+    }
+}
+
+// Splits $WCxxx?TrueText:FalseText$ at index and returns the selected text.
+// Placeholders which come earlier in the table are expanded inside the
+// texts first, since they used to be replaced before this one was looked at.
+static bool ExpandBoolean(SubWcExpand_t * ex, int id, size_t index,
+                          std::string & value, size_t & next)
+{
+    const SubWcPlaceholder_t & ph = Placeholders[id];
+    std::string text;
+    std::string tail;       // rest of a nested value behind the terminating '$'
+    bool bTerminated = false;
+    size_t pos = index + ph.DefLen;
+    while (pos < ex->filelength)
+    {
+        const char * pDollar = (const char *)memchr(ex->pBuf + pos, '$', ex->filelength - pos);
+        if (pDollar == NULL)
+            break;
+        size_t dollar = pDollar - ex->pBuf;
+        text.append(ex->pBuf + pos, dollar - pos);
+
+        int nested = MatchPlaceholder(ex, dollar);
+        std::string nestedvalue;
+        size_t nestednext = 0;
+        if ((nested >= 0) && (nested < id) && ExpandPlaceholder(ex, nested, dollar, nestedvalue, nestednext))
+        {
+            size_t term = nestedvalue.find('$');
+            if (term == std::string::npos)
+            {
+                text.append(nestedvalue);
+                pos = nestednext;
+                continue;
+            }
+            text.append(nestedvalue, 0, term);
+            tail.assign(nestedvalue, term + 1, std::string::npos);
+            next = nestednext;
+        }
+        else
+        {
+            next = dollar + 1;
+        }
+        bTerminated = true;
+        break;
+    }
+    if (!bTerminated)
+        return false;   // No terminator - malformed so give up.
+
+    // Look for the ':' dividing TrueText from FalseText
+    size_t split = text.find(':');
+    if (split == std::string::npos)
+        return false;   // No split - malformed so give up.
+
+    if (GetBoolean(ex->SubStat, ph.Field))
+        value.assign(text, 0, split);
+    else
+        value.assign(text, split + 1, std::string::npos);
+    value.append(tail);
+    return true;
+}
+
+// Computes the replacement for the placeholder id found at index.
+// Returns false if the placeholder stays as it is, either because it is
+// malformed or because an earlier placeholder overlaps its closing '$'.
+static bool ExpandPlaceholder(SubWcExpand_t * ex, int id, size_t index,
+                              std::string & value, size_t & next)
+{
+    const SubWcPlaceholder_t & ph = Placeholders[id];
+    // A malformed placeholder ends the search for that placeholder, so
+    // later occurrences are left alone.
+    if (index >= ex->DisabledAt[id])
+        return false;
+
+    if (ph.Kind == PH_BOOLEAN)
+    {
+        if (!ExpandBoolean(ex, id, index, value, next))
+        {
+            DisablePlaceholder(ex, id, index);
+            return false;
+        }
+        return true;
+    }
+
+    // A placeholder ending in '$' shares that character with a placeholder
+    // following directly behind it, and the one earlier in the table wins.
+    size_t last = index + ph.DefLen - 1;
+    if (ex->pBuf[last] == '$')
+    {
+        int right = MatchPlaceholder(ex, last);
+        std::string rightvalue;
+        size_t rightnext = 0;
+        if ((right >= 0) && (right < id) && ExpandPlaceholder(ex, right, last, rightvalue, rightnext))
+            return false;
+    }
+
+    const SubWCRev_t * SubStat = ex->SubStat;
+    switch (ph.Field)
+    {
+    case WCF_REV:
+        FormatRevision(value, -1, SubStat->CmtRev, SubStat);
+        break;
+    case WCF_RANGE:
+        FormatRevision(value, SubStat->MinRev, SubStat->MaxRev, SubStat);
+        break;
+    case WCF_DATE:
+    case WCF_NOW:
+    case WCF_LOCKDATE:
+        {
+            apr_time_t date = SubStat->CmtDate;
+            if (ph.Field == WCF_NOW)
+                date = USE_TIME_NOW;
+            else if (ph.Field == WCF_LOCKDATE)
+                date = SubStat->LockData.CreationDate;
+            if (!FormatDate(value, date))
+            {
+                DisablePlaceholder(ex, id, index);
+                return false;
+            }
+        }
+        break;
+    case WCF_URL:
+        value.assign(SubStat->Url);
+        break;
+    case WCF_LOCKOWNER:
+        value.assign(SubStat->LockData.Owner);
+        break;
+    case WCF_LOCKCOMMENT:
+        value.assign(SubStat->LockData.Comment);
+        break;
+    default:
+        return false;
+    }
+    next = index + ph.DefLen;
+    return true;
+}
+
+unsigned TemplateFields(const char * pBuf, size_t filelength)
+{
+    SubWcExpand_t ex;
+    memset(&ex, 0, sizeof(ex));
+    ex.pBuf = pBuf;
+    ex.filelength = filelength;
+
+    unsigned fields = 0;
+    size_t index = 0;
+    while (index < filelength)
+    {
+        const char * pDollar = (const char *)memchr(pBuf + index, '$', filelength - index);
+        if (pDollar == NULL)
+            break;
+        index = pDollar - pBuf;
+        int id = MatchPlaceholder(&ex, index);
+        if (id >= 0)
+            fields |= WCF_MASK(Placeholders[id].Field);
+        index++;
+    }
+    return fields;
+}
+
+void ExpandTemplate(const char * pBuf, size_t filelength,
+                    const SubWCRev_t * SubStat, std::string & out)
+{
+    SubWcExpand_t ex;
+    ex.pBuf = pBuf;
+    ex.filelength = filelength;
+    ex.SubStat = SubStat;
+    for (int i = 0; i < PLACEHOLDER_COUNT; ++i)
+        ex.DisabledAt[i] = (size_t)-1;
+
+    out.reserve(out.size() + filelength + filelength / 8);
+
+    std::string value;
+    size_t index = 0;
+    while (index < filelength)
+    {
+        const char * pDollar = (const char *)memchr(pBuf + index, '$', filelength - index);
+        if (pDollar == NULL)
+            break;
+        size_t dollar = pDollar - pBuf;
+        out.append(pBuf + index, dollar - index);
+
+        size_t next = 0;
+        int id = MatchPlaceholder(&ex, dollar);
+        if ((id >= 0) && ExpandPlaceholder(&ex, id, dollar, value, next))
+        {
+            out.append(value);
+            index = next;
+        }
+        else
+        {
+            out.push_back('$');
+            index = dollar + 1;
+        }
+    }
+    if (index < filelength)
+        out.append(pBuf + index, filelength - index);
+}
+
+// What the value of a compiled placeholder may contain. Inside the text
+// of a $WCxxx?...$ this decides where the text ends and where it is
+// split, so such values have to be known before expanding.
+#define TV_DOLLAR   0x01
+#define TV_COLON    0x02
+
+// A compiled placeholder or literal, before it is flattened into the
+// operations of a SubWcTemplate_t.
+typedef struct SubWcNode_t
+{
+    SubWcTemplateOpCode_t Op;
+    SubWcField_t Field;
+    unsigned May;                       // TV_xxx
+    std::string Text;                   // TOP_LITERAL
+    std::vector<SubWcNode_t> True;      // TOP_BOOLEAN
+    std::vector<SubWcNode_t> False;
+} SubWcNode_t;
+
+// State of one template compilation.
+typedef struct SubWcCompile_t
+{
+    SubWcExpand_t ex;
+    bool bInterpret;    // the result depends on the values, not only on the template
+} SubWcCompile_t;
+
+static void AppendLiteral(std::vector<SubWcNode_t> & nodes, const char * p, size_t len)
+{
+    if (len == 0)
+        return;
+    if (nodes.empty() || (nodes.back().Op != TOP_LITERAL))
+    {
+        nodes.push_back(SubWcNode_t());
+        nodes.back().Op = TOP_LITERAL;
+        nodes.back().Field = WCF_REV;
+        nodes.back().May = 0;
+    }
+    nodes.back().Text.append(p, len);
+    if (memchr(p, ':', len))
+        nodes.back().May |= TV_COLON;
+}
+
+static bool CompilePlaceholder(SubWcCompile_t * cc, int id, size_t index,
+                               SubWcNode_t & node, size_t & next);
+
+// The compiling counterpart of ExpandBoolean(): the text is split into
+// literals and nested placeholders, and the split at the first ':' has
+// to lie in a literal.
+static bool CompileBoolean(SubWcCompile_t * cc, int id, size_t index,
+                           SubWcNode_t & node, size_t & next)
+{
+    SubWcExpand_t * ex = &cc->ex;
+    const SubWcPlaceholder_t & ph = Placeholders[id];
+    std::vector<SubWcNode_t> parts;
+    bool bTerminated = false;
+    size_t pos = index + ph.DefLen;
+    while (pos < ex->filelength)
+    {
+        const char * pDollar = (const char *)memchr(ex->pBuf + pos, '$', ex->filelength - pos);
+        if (pDollar == NULL)
+            break;
+        size_t dollar = pDollar - ex->pBuf;
+        AppendLiteral(parts, ex->pBuf + pos, dollar - pos);
+
+        int nested = MatchPlaceholder(ex, dollar);
+        SubWcNode_t nestednode;
+        size_t nestednext = 0;
+        if ((nested >= 0) && (nested < id) && CompilePlaceholder(cc, nested, dollar, nestednode, nestednext))
+        {
+            // a '$' in the value would end the text
+            if (nestednode.May & TV_DOLLAR)
+                cc->bInterpret = true;
+            parts.push_back(nestednode);
+            pos = nestednext;
+            continue;
+        }
+        next = dollar + 1;
+        bTerminated = true;
+        break;
+    }
+    if (!bTerminated)
+        return false;   // No terminator - malformed so give up.
+
+    // Look for the ':' dividing TrueText from FalseText
+    size_t split = parts.size();
+    size_t splitpos = 0;
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        if (parts[i].Op == TOP_LITERAL)
+        {
+            splitpos = parts[i].Text.find(':');
+            if (splitpos != std::string::npos)
+            {
+                split = i;
+                break;
+            }
+        }
+        else if (parts[i].May & TV_COLON)
+        {
+            // the value may hold the first ':'
+            cc->bInterpret = true;
+            return false;
+        }
+    }
+    if (split == parts.size())
+        return false;   // No split - malformed so give up.
+
+    node.Op = TOP_BOOLEAN;
+    node.Field = ph.Field;
+    node.May = 0;
+    node.True.assign(parts.begin(), parts.begin() + split);
+    AppendLiteral(node.True, parts[split].Text.data(), splitpos);
+    AppendLiteral(node.False, parts[split].Text.data() + splitpos + 1, parts[split].Text.size() - splitpos - 1);
+    node.False.insert(node.False.end(), parts.begin() + split + 1, parts.end());
+    for (size_t i = 0; i < node.True.size(); ++i)
+        node.May |= node.True[i].May;
+    for (size_t i = 0; i < node.False.size(); ++i)
+        node.May |= node.False[i].May;
+    return true;
+}
+
+// The compiling counterpart of ExpandPlaceholder().
+static bool CompilePlaceholder(SubWcCompile_t * cc, int id, size_t index,
+                               SubWcNode_t & node, size_t & next)
+{
+    SubWcExpand_t * ex = &cc->ex;
+    const SubWcPlaceholder_t & ph = Placeholders[id];
+    if (index >= ex->DisabledAt[id])
+        return false;
+
+    if (ph.Kind == PH_BOOLEAN)
+    {
+        if (!CompileBoolean(cc, id, index, node, next))
+        {
+            DisablePlaceholder(ex, id, index);
+            return false;
+        }
+        return true;
+    }
+
+    size_t last = index + ph.DefLen - 1;
+    if (ex->pBuf[last] == '$')
+    {
+        int right = MatchPlaceholder(ex, last);
+        SubWcNode_t rightnode;
+        size_t rightnext = 0;
+        if ((right >= 0) && (right < id) && CompilePlaceholder(cc, right, last, rightnode, rightnext))
+            return false;
+    }
+
+    node.Op = TOP_FIELD;
+    node.Field = ph.Field;
+    switch (ph.Field)
+    {
+    case WCF_REV:
+        node.May = 0;
+        break;
+    case WCF_URL:
+    case WCF_LOCKOWNER:
+    case WCF_LOCKCOMMENT:
+        node.May = TV_DOLLAR | TV_COLON;
+        break;
+    default:
+        // a range or a date
+        node.May = TV_COLON;
+        break;
+    }
+    next = index + ph.DefLen;
+    return true;
+}
+
+static void FlattenNodes(const std::vector<SubWcNode_t> & nodes, SubWcTemplate_t * tmpl)
+{
+    for (std::vector<SubWcNode_t>::const_iterator I = nodes.begin(); I != nodes.end(); ++I)
+    {
+        SubWcTemplateOp_t op;
+        op.Op = I->Op;
+        op.Field = I->Field;
+        op.A = 0;
+        op.B = 0;
+        if (I->Op == TOP_LITERAL)
+        {
+            op.A = (apr_uint32_t)tmpl->Literals.size();
+            op.B = (apr_uint32_t)I->Text.size();
+            tmpl->Literals.append(I->Text);
+            tmpl->Ops.push_back(op);
+        }
+        else if (I->Op == TOP_FIELD)
+            tmpl->Ops.push_back(op);
+        else
+        {
+            size_t at = tmpl->Ops.size();
+            tmpl->Ops.push_back(op);
+            FlattenNodes(I->True, tmpl);
+            size_t end = tmpl->Ops.size();
+            FlattenNodes(I->False, tmpl);
+            tmpl->Ops[at].A = (apr_uint32_t)(end - at - 1);
+            tmpl->Ops[at].B = (apr_uint32_t)(tmpl->Ops.size() - end);
+        }
+    }
+}
+
+bool CompileTemplate(const char * pBuf, size_t filelength, SubWcTemplate_t * tmpl)
+{
+    SubWcCompile_t cc;
+    cc.ex.pBuf = pBuf;
+    cc.ex.filelength = filelength;
+    cc.ex.SubStat = NULL;
+    for (int i = 0; i < PLACEHOLDER_COUNT; ++i)
+        cc.ex.DisabledAt[i] = (size_t)-1;
+    cc.bInterpret = false;
+
+    std::vector<SubWcNode_t> nodes;
+    size_t index = 0;
+    while (index < filelength)
+    {
+        const char * pDollar = (const char *)memchr(pBuf + index, '$', filelength - index);
+        if (pDollar == NULL)
+            break;
+        size_t dollar = pDollar - pBuf;
+        AppendLiteral(nodes, pBuf + index, dollar - index);
+
+        SubWcNode_t node;
+        size_t next = 0;
+        int id = MatchPlaceholder(&cc.ex, dollar);
+        if ((id >= 0) && CompilePlaceholder(&cc, id, dollar, node, next))
+        {
+            nodes.push_back(node);
+            index = next;
+        }
+        else
+        {
+            AppendLiteral(nodes, "$", 1);
+            index = dollar + 1;
+        }
+    }
+    if (index < filelength)
+        AppendLiteral(nodes, pBuf + index, filelength - index);
+
+    tmpl->Fields = TemplateFields(pBuf, filelength);
+    tmpl->bInterpret = cc.bInterpret;
+    tmpl->Literals.clear();
+    tmpl->Ops.clear();
+    if (!cc.bInterpret)
+        FlattenNodes(nodes, tmpl);
+    return !cc.bInterpret;
+}
+
+static void RunOps(const SubWcTemplate_t * tmpl, size_t begin, size_t end, const SubWCRev_t * SubStat,
+                   const std::string * values, std::string & out)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        const SubWcTemplateOp_t & op = tmpl->Ops[i];
+        switch (op.Op)
+        {
+        case TOP_LITERAL:
+            out.append(tmpl->Literals, op.A, op.B);
+            break;
+        case TOP_FIELD:
+            out.append(values[op.Field]);
+            break;
+        case TOP_BOOLEAN:
+            if (GetBoolean(SubStat, (SubWcField_t)op.Field))
+                RunOps(tmpl, i + 1, i + 1 + op.A, SubStat, values, out);
+            else
+                RunOps(tmpl, i + 1 + op.A, i + 1 + op.A + op.B, SubStat, values, out);
+            i += op.A + op.B;
+            break;
+        }
+    }
+}
+
+bool ExpandCompiled(const SubWcTemplate_t * tmpl, const SubWCRev_t * SubStat, std::string & out)
+{
+    if (tmpl->bInterpret)
+        return false;
+
+    // Every value is formatted once. A date which cannot be formatted
+    // changes how the template is read, which only the interpreter knows.
+    std::string values[WCF_UNVER + 1];
+    unsigned fields = tmpl->Fields;
+    if (fields & WCF_MASK(WCF_REV))
+        FormatRevision(values[WCF_REV], -1, SubStat->CmtRev, SubStat);
+    if (fields & WCF_MASK(WCF_RANGE))
+        FormatRevision(values[WCF_RANGE], SubStat->MinRev, SubStat->MaxRev, SubStat);
+    if ((fields & WCF_MASK(WCF_DATE)) && !FormatDate(values[WCF_DATE], SubStat->CmtDate))
+        return false;
+    if ((fields & WCF_MASK(WCF_NOW)) && !FormatDate(values[WCF_NOW], USE_TIME_NOW))
+        return false;
+    if ((fields & WCF_MASK(WCF_LOCKDATE)) && !FormatDate(values[WCF_LOCKDATE], SubStat->LockData.CreationDate))
+        return false;
+    values[WCF_URL].assign(SubStat->Url);
+    values[WCF_LOCKOWNER].assign(SubStat->LockData.Owner);
+    values[WCF_LOCKCOMMENT].assign(SubStat->LockData.Comment);
+
+    out.reserve(out.size() + tmpl->Literals.size() + tmpl->Literals.size() / 8);
+    RunOps(tmpl, 0, tmpl->Ops.size(), SubStat, values, out);
+    return true;
+}
@@ -0,0 +1,119 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#pragma once
+#include <string>
+#include <vector>
+#include "SVNWcRev.h"
+
+// Value for apr_time_t to signify "now"
+#define USE_TIME_NOW    -2 // 0 and -1 might already be significant.
+
+/**
+ * \ingroup SubWCRev
+ * The pieces of information a placeholder can be replaced with.
+ */
+typedef enum SubWcField_t
+{
+    WCF_REV,            // $WCREV$
+    WCF_RANGE,          // $WCRANGE$
+    WCF_DATE,           // $WCDATE$ and friends
+    WCF_NOW,            // $WCNOW$ and friends
+    WCF_MODS,           // $WCMODS?...$
+    WCF_MIXED,          // $WCMIXED?...$
+    WCF_URL,            // $WCURL$
+    WCF_INSVN,          // $WCINSVN?...$
+    WCF_NEEDSLOCK,      // $WCNEEDSLOCK?...$
+    WCF_ISLOCKED,       // $WCISLOCKED?...$
+    WCF_LOCKDATE,       // $WCLOCKDATE$ and friends
+    WCF_LOCKOWNER,      // $WCLOCKOWNER$
+    WCF_LOCKCOMMENT,    // $WCLOCKCOMMENT$
+    WCF_UNVER           // $WCUNVER?...$
+} SubWcField_t;
+
+#define WCF_MASK(field)     (1u << (field))
+
+// The fields taken from the last node the crawl reports, whatever it is
+#define WCF_LAST_NODE       (WCF_MASK(WCF_INSVN) | WCF_MASK(WCF_ISLOCKED) | WCF_MASK(WCF_LOCKDATE) | \
+                             WCF_MASK(WCF_LOCKOWNER) | WCF_MASK(WCF_LOCKCOMMENT))
+
+/**
+ * \ingroup SubWCRev
+ * Returns the set of fields (WCF_MASK bits) referenced by the
+ * placeholders of the template in pBuf.
+ */
+unsigned TemplateFields(const char * pBuf, size_t filelength);
+
+/**
+ * \ingroup SubWCRev
+ * Replaces all $WCxxx placeholders of the template in pBuf with the
+ * information collected in SubStat and appends the result to out.
+ * The template is scanned only once; the result is the same as
+ * expanding one placeholder kind after the other, in the order of the
+ * placeholder table, over the whole buffer.
+ */
+void ExpandTemplate(const char * pBuf, size_t filelength,
+                    const SubWCRev_t * SubStat, std::string & out);
+
+/**
+ * \ingroup SubWCRev
+ * The operations of a compiled template.
+ */
+typedef enum SubWcTemplateOpCode_t
+{
+    TOP_LITERAL,        // append A..A+B of Literals
+    TOP_FIELD,          // append the value of Field
+    TOP_BOOLEAN         // run the next A operations if Field is true, else the B after them
+} SubWcTemplateOpCode_t;
+
+typedef struct SubWcTemplateOp_t
+{
+    SubWcTemplateOpCode_t Op;
+    SubWcField_t Field;
+    apr_uint32_t A;
+    apr_uint32_t B;
+} SubWcTemplateOp_t;
+
+/**
+ * \ingroup SubWCRev
+ * A template compiled into literals and placeholder operations, so it
+ * can be expanded without looking for the placeholders again.
+ */
+typedef struct SubWcTemplate_t
+{
+    unsigned Fields;                        // TemplateFields() of the template
+    bool bInterpret;                        // cannot be compiled, use ExpandTemplate()
+    std::string Literals;
+    std::vector<SubWcTemplateOp_t> Ops;
+} SubWcTemplate_t;
+
+/**
+ * \ingroup SubWCRev
+ * Compiles the template in pBuf. Returns FALSE, with tmpl->bInterpret set,
+ * if the result depends on the values in a way only ExpandTemplate()
+ * handles, e.g. a $WCURL$ inside the text of a $WCINSVN?...$.
+ */
+bool CompileTemplate(const char * pBuf, size_t filelength, SubWcTemplate_t * tmpl);
+
+/**
+ * \ingroup SubWCRev
+ * Appends the compiled template tmpl, expanded with SubStat, to out. The
+ * result is the same as that of ExpandTemplate(). Returns FALSE, leaving
+ * out alone, if the template has to be expanded by ExpandTemplate()
+ * with these values.
+ */
+bool ExpandCompiled(const SubWcTemplate_t * tmpl, const SubWCRev_t * SubStat, std::string & out);
@@ -0,0 +1,420 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <apr_pools.h>
+#include "svn_wc.h"
+#include "svn_dirent_uri.h"
+#include "wcdb.h"
+#include <sqlite3.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Working copy formats whose NODES table we know about
+#define WC_FORMAT_MIN   29  // Subversion 1.7
+#define WC_FORMAT_MAX   32  // Subversion 1.15
+
+// The nodes below and including the crawl root which svn status reports
+// with their BASE revision.
+#define NODES_BELOW \
+    "FROM NODES WHERE wc_id = ?1 AND op_depth = 0 " \
+    "AND presence IN ('normal', 'incomplete') AND repos_id = ?3 " \
+    "AND (?2 = '' OR local_relpath = ?2 " \
+    "OR (local_relpath > ?2 || '/' AND local_relpath < ?2 || '0')) "
+
+typedef struct SubWcDb_t
+{
+    sqlite3 * db;
+    sqlite3_int64 wc_id;
+    const char * relpath;       // crawl root, relative to the working copy root
+    sqlite3_int64 repos_id;
+} SubWcDb_t;
+
+// Looks for the administrative directory from path upwards and returns
+// the path of its wc.db, or NULL.
+static const char * FindWcDb(const char * path, const char ** wcroot, apr_pool_t * pool)
+{
+    const char * adm = svn_wc_get_adm_dir(pool);
+    const char * dir = path;
+    struct stat st;
+    if ((stat(dir, &st) == 0) && !S_ISDIR(st.st_mode))
+        dir = svn_dirent_dirname(dir, pool);
+    for (;;)
+    {
+        const char * dbpath = svn_dirent_join(svn_dirent_join(dir, adm, pool), "wc.db", pool);
+        if (access(dbpath, R_OK) == 0)
+        {
+            *wcroot = dir;
+            return dbpath;
+        }
+        if (svn_dirent_is_root(dir, strlen(dir)))
+            return NULL;
+        dir = svn_dirent_dirname(dir, pool);
+    }
+}
+
+static sqlite3_stmt * Prepare(const SubWcDb_t * wcdb, const char * sql)
+{
+    sqlite3_stmt * stmt = NULL;
+    if (sqlite3_prepare_v2(wcdb->db, sql, -1, &stmt, NULL) != SQLITE_OK)
+        return NULL;
+    sqlite3_bind_int64(stmt, 1, wcdb->wc_id);
+    sqlite3_bind_text(stmt, 2, wcdb->relpath, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, wcdb->repos_id);
+    return stmt;
+}
+
+// Runs a query returning a single integer.
+static bool QueryInt(const SubWcDb_t * wcdb, const char * sql, sqlite3_int64 * value)
+{
+    sqlite3_stmt * stmt = Prepare(wcdb, sql);
+    if (stmt == NULL)
+        return false;
+    bool ret = (sqlite3_step(stmt) == SQLITE_ROW);
+    if (ret)
+        *value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+static bool QueryRevisions(SubWcDb_t * wcdb, SubWCRev_t * SubStat)
+{
+    // Added, deleted, copied or moved nodes are reported by svn status
+    // with revisions which are not in BASE: let the crawl handle them.
+    sqlite3_int64 working = 0;
+    if (!QueryInt(wcdb, "SELECT EXISTS(SELECT 1 FROM NODES WHERE wc_id = ?1 AND op_depth > 0 "
+                        "AND (?2 = '' OR local_relpath = ?2 "
+                        "OR (local_relpath > ?2 || '/' AND local_relpath < ?2 || '0')))", &working) ||
+        working)
+        return false;
+
+    // The crawl root gives the URL, the repository and the author.
+    sqlite3_stmt * stmt = Prepare(wcdb, "SELECT n.repos_id, n.repos_path, n.changed_author, r.root "
+                                        "FROM NODES n JOIN REPOSITORY r ON r.id = n.repos_id "
+                                        "WHERE n.wc_id = ?1 AND n.local_relpath = ?2 AND n.op_depth = 0 "
+                                        "AND n.presence IN ('normal', 'incomplete')");
+    if (stmt == NULL)
+        return false;
+    if (sqlite3_step(stmt) != SQLITE_ROW)
+    {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    wcdb->repos_id = sqlite3_column_int64(stmt, 0);
+    const char * repos_path = (const char *)sqlite3_column_text(stmt, 1);
+    const char * author = (const char *)sqlite3_column_text(stmt, 2);
+    const char * root = (const char *)sqlite3_column_text(stmt, 3);
+    if ((repos_path == NULL) || (root == NULL))
+    {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    SubWCRev_t Result;
+    memcpy(&Result, SubStat, sizeof(Result));
+    UnescapeCopy(root, repos_path, Result.Url, URL_BUF);
+    Result.bIsTagged = IsTaggedVersion(Result.Url);
+    strncpy(Result.RootUrl, root, URL_BUF);
+    if (author)
+        strncpy(Result.Author, author, URL_BUF);
+    sqlite3_finalize(stmt);
+
+    // MIN/MAX over the nodes give what getallstatus() collects node by node
+    stmt = Prepare(wcdb, "SELECT MIN(CASE WHEN revision > 0 THEN revision END), MAX(revision) " NODES_BELOW);
+    if ((stmt == NULL) || (sqlite3_step(stmt) != SQLITE_ROW))
+    {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    Result.MinRev = (svn_revnum_t)sqlite3_column_int64(stmt, 0);
+    Result.MaxRev = (svn_revnum_t)sqlite3_column_int64(stmt, 1);
+    sqlite3_finalize(stmt);
+
+    stmt = Prepare(wcdb, SubStat->bFolders
+                         ? "SELECT changed_revision, changed_date " NODES_BELOW
+                           "ORDER BY changed_revision DESC LIMIT 1"
+                         : "SELECT changed_revision, changed_date " NODES_BELOW
+                           "AND kind != 'dir' ORDER BY changed_revision DESC LIMIT 1");
+    if (stmt == NULL)
+        return false;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW)
+    {
+        Result.CmtRev = (svn_revnum_t)sqlite3_column_int64(stmt, 0);
+        Result.CmtDate = (apr_time_t)sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    if ((rc != SQLITE_ROW) && (rc != SQLITE_DONE))
+        return false;
+
+    memcpy(SubStat, &Result, sizeof(Result));
+    return true;
+}
+
+// Opens the wc.db of the working copy containing path, read-only.
+static bool OpenWcDb(const char * path, SubWcDb_t * wcdb, const char ** wcroot,
+                     const char ** dbpath, apr_pool_t * pool)
+{
+    memset(wcdb, 0, sizeof(SubWcDb_t));
+    *dbpath = FindWcDb(path, wcroot, pool);
+    if (*dbpath == NULL)
+        return false;
+
+    wcdb->relpath = svn_dirent_skip_ancestor(*wcroot, path);
+    if (wcdb->relpath == NULL)
+        return false;
+    if (sqlite3_open_v2(*dbpath, &wcdb->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        sqlite3_close(wcdb->db);
+        wcdb->db = NULL;
+        return false;
+    }
+    sqlite3_busy_timeout(wcdb->db, 10000);
+
+    sqlite3_int64 format = 0;
+    if (!QueryInt(wcdb, "PRAGMA user_version", &format) ||
+        (format < WC_FORMAT_MIN) || (format > WC_FORMAT_MAX) ||
+        !QueryInt(wcdb, "SELECT id FROM WCROOT WHERE local_abspath IS NULL", &wcdb->wc_id))
+    {
+        sqlite3_close(wcdb->db);
+        wcdb->db = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool WcDbGetRevisions(const char * path, SubWCRev_t * SubStat, apr_pool_t * pool)
+{
+    SubWcDb_t wcdb;
+    const char * wcroot = NULL;
+    const char * dbpath = NULL;
+    if (!OpenWcDb(path, &wcdb, &wcroot, &dbpath, pool))
+        return false;
+
+    bool ret = QueryRevisions(&wcdb, SubStat);
+    sqlite3_close(wcdb.db);
+    return ret;
+}
+
+void HashBytes(apr_uint64_t * hash, const void * data, size_t len)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i)
+    {
+        *hash ^= p[i];
+        *hash *= 1099511628211ULL;
+    }
+}
+
+static void HashStat(apr_uint64_t * hash, const char * path, bool bDir)
+{
+    struct stat st;
+    apr_int64_t values[5];
+    memset(values, 0, sizeof(values));
+    if (lstat(path, &st) == 0)
+    {
+        values[0] = st.st_mtim.tv_sec;
+        values[1] = st.st_mtim.tv_nsec;
+        if (!bDir)
+        {
+            values[2] = st.st_size;
+            values[3] = st.st_ino;
+            values[4] = st.st_mode;
+        }
+    }
+    else
+        values[0] = -1;
+    HashBytes(hash, values, sizeof(values));
+}
+
+// Lists the directory externals below the crawl root which svn has
+// checked out, relative to the working copy root.
+static bool ListExternals(const SubWcDb_t * wcdb, std::vector<std::string> & externals)
+{
+    sqlite3_stmt * stmt = Prepare(wcdb, "SELECT local_relpath FROM EXTERNALS WHERE wc_id = ?1 AND kind = 'dir' "
+                                        "AND (?2 = '' OR local_relpath = ?2 "
+                                        "OR (local_relpath > ?2 || '/' AND local_relpath < ?2 || '0')) "
+                                        "ORDER BY local_relpath");
+    if (stmt == NULL)
+        return false;
+    int rc = SQLITE_DONE;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const char * relpath = (const char *)sqlite3_column_text(stmt, 0);
+        if (relpath)
+            externals.push_back(relpath);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+static bool Fingerprint(const char * path, bool bExternals, bool bFiles, apr_uint64_t * hash, apr_pool_t * pool)
+{
+    SubWcDb_t wcdb;
+    const char * wcroot = NULL;
+    const char * dbpath = NULL;
+    if (!OpenWcDb(path, &wcdb, &wcroot, &dbpath, pool))
+        return false;
+
+    // wc.db changes with every update, commit, lock, property change...
+    struct stat st;
+    bool ret = (stat(dbpath, &st) == 0);
+    if (ret)
+    {
+        apr_int64_t values[5] = { (apr_int64_t)st.st_dev, (apr_int64_t)st.st_ino, st.st_size,
+                                  st.st_mtim.tv_sec, st.st_mtim.tv_nsec };
+        HashBytes(hash, dbpath, strlen(dbpath));
+        HashBytes(hash, values, sizeof(values));
+    }
+
+    // ...but editing files or adding unversioned ones does not touch it:
+    // look at the timestamps of the versioned directories as well, which
+    // change whenever an item in them is added, removed or renamed. Only
+    // text modifications need a stat of every versioned file.
+    static const char * const nodesSql[2] = {
+        "SELECT DISTINCT local_relpath, kind FROM NODES WHERE wc_id = ?1 AND kind = 'dir' "
+        "AND (?2 = '' OR local_relpath = ?2 "
+        "OR (local_relpath > ?2 || '/' AND local_relpath < ?2 || '0')) "
+        "ORDER BY local_relpath",
+        "SELECT DISTINCT local_relpath, kind FROM NODES WHERE wc_id = ?1 "
+        "AND (?2 = '' OR local_relpath = ?2 "
+        "OR (local_relpath > ?2 || '/' AND local_relpath < ?2 || '0')) "
+        "ORDER BY local_relpath"
+    };
+    sqlite3_stmt * stmt = ret ? Prepare(&wcdb, nodesSql[bFiles ? 1 : 0]) : NULL;
+    ret = (stmt != NULL);
+    apr_pool_t * iterpool = NULL;
+    apr_pool_create(&iterpool, pool);
+    int rc = SQLITE_DONE;
+    while (ret && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+    {
+        apr_pool_clear(iterpool);
+        const char * relpath = (const char *)sqlite3_column_text(stmt, 0);
+        const char * kind = (const char *)sqlite3_column_text(stmt, 1);
+        if ((relpath == NULL) || (kind == NULL))
+            continue;
+        HashBytes(hash, relpath, strlen(relpath) + 1);
+        HashStat(hash, svn_dirent_join(wcroot, relpath, iterpool), strcmp(kind, "dir") == 0);
+    }
+    if (rc != SQLITE_DONE)
+        ret = false;
+    sqlite3_finalize(stmt);
+
+    // Externals are separate working copies with their own wc.db
+    if (ret && bExternals)
+    {
+        std::vector<std::string> externals;
+        ret = ListExternals(&wcdb, externals);
+        for (std::vector<std::string>::const_iterator I = externals.begin(); ret && (I != externals.end()); ++I)
+        {
+            const char * extpath = svn_dirent_join(wcroot, I->c_str(), pool);
+            HashBytes(hash, I->c_str(), I->size() + 1);
+            // an external which is not checked out yet simply has no wc.db
+            if (access(extpath, F_OK) == 0)
+                ret = Fingerprint(extpath, bExternals, bFiles, hash, pool);
+        }
+    }
+    apr_pool_destroy(iterpool);
+    sqlite3_close(wcdb.db);
+    return ret;
+}
+
+bool WcDbFingerprint(const char * path, bool bExternals, bool bFiles, apr_uint64_t * fingerprint, apr_pool_t * pool)
+{
+    *fingerprint = HASH_INIT;
+    return Fingerprint(path, bExternals, bFiles, fingerprint, pool);
+}
+
+bool WcDbListFiles(const char * path, std::vector<SubWcDbFile_t> & files, apr_pool_t * pool)
+{
+    SubWcDb_t wcdb;
+    const char * wcroot = NULL;
+    const char * dbpath = NULL;
+    if (!OpenWcDb(path, &wcdb, &wcroot, &dbpath, pool))
+        return false;
+
+    // The recorded size and timestamp live in the row of the highest
+    // op_depth, where svn also looks for them.
+    sqlite3_stmt * stmt = Prepare(&wcdb, "SELECT n.local_relpath, n.translated_size, n.last_mod_time, n.checksum "
+                                         "FROM NODES n WHERE n.wc_id = ?1 "
+                                         "AND (?2 = '' OR n.local_relpath = ?2 "
+                                         "OR (n.local_relpath > ?2 || '/' AND n.local_relpath < ?2 || '0')) "
+                                         "AND n.kind IN ('file', 'symlink') AND n.presence = 'normal' "
+                                         "AND n.op_depth = (SELECT MAX(op_depth) FROM NODES m "
+                                         "WHERE m.wc_id = n.wc_id AND m.local_relpath = n.local_relpath)");
+    // pristine copies are kept as pristine/<first two digits>/<sha1>.svn-base
+    std::string pristinedir = svn_dirent_join(svn_dirent_join(wcroot, svn_wc_get_adm_dir(pool), pool), "pristine", pool);
+    bool ret = (stmt != NULL);
+    int rc = SQLITE_DONE;
+    while (ret && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+    {
+        const char * relpath = (const char *)sqlite3_column_text(stmt, 0);
+        const char * checksum = (const char *)sqlite3_column_text(stmt, 3);
+        if (relpath == NULL)
+            continue;
+        files.push_back(SubWcDbFile_t());
+        SubWcDbFile_t & file = files.back();
+        file.Path.reserve(strlen(wcroot) + strlen(relpath) + 1);
+        file.Path.assign(wcroot);
+        if (*relpath)
+            file.Path.append("/").append(relpath);
+        if (checksum && (strncmp(checksum, "$sha1$", 6) == 0) && (strlen(checksum + 6) == 40))
+            file.Pristine.append(pristinedir).append("/").append(checksum + 6, 2).append("/").append(checksum + 6).append(".svn-base");
+        file.Size = (sqlite3_column_type(stmt, 1) == SQLITE_NULL) ? -1 : sqlite3_column_int64(stmt, 1);
+        file.ModTime = sqlite3_column_int64(stmt, 2);
+    }
+    if (rc != SQLITE_DONE)
+        ret = false;
+    sqlite3_finalize(stmt);
+    sqlite3_close(wcdb.db);
+    return ret;
+}
+
+bool WcDbDependencies(const char * path, bool bExternals, bool bFiles, std::vector<std::string> & deps,
+                      apr_pool_t * pool)
+{
+    SubWcDb_t wcdb;
+    const char * wcroot = NULL;
+    const char * dbpath = FindWcDb(path, &wcroot, pool);
+    if (dbpath == NULL)
+        return false;
+    deps.push_back(dbpath);
+    if (bFiles)
+    {
+        std::vector<SubWcDbFile_t> files;
+        WcDbListFiles(path, files, pool);
+        for (std::vector<SubWcDbFile_t>::const_iterator I = files.begin(); I != files.end(); ++I)
+            deps.push_back(I->Path);
+    }
+    if (!bExternals || !OpenWcDb(path, &wcdb, &wcroot, &dbpath, pool))
+        return true;
+
+    // Externals not checked out have no wc.db yet; the one of their
+    // parent changes when they are.
+    std::vector<std::string> externals;
+    ListExternals(&wcdb, externals);
+    sqlite3_close(wcdb.db);
+    for (std::vector<std::string>::const_iterator I = externals.begin(); I != externals.end(); ++I)
+    {
+        const char * extpath = svn_dirent_join(wcroot, I->c_str(), pool);
+        if (access(extpath, F_OK) == 0)
+            WcDbDependencies(extpath, bExternals, bFiles, deps, pool);
+    }
+    return true;
+}
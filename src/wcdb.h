@@ -0,0 +1,91 @@
+// TortoiseSVN - a Windows shell extension for easy version control
+
+// Copyright (C) 2003-2013 - TortoiseSVN
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#pragma once
+#include <string>
+#include <vector>
+#include "SVNWcRev.h"
+#include "template.h"
+
+// The fields WcDbGetRevisions() can answer
+#define WCDB_FIELDS (WCF_MASK(WCF_REV) | WCF_MASK(WCF_RANGE) | WCF_MASK(WCF_DATE) | \
+                     WCF_MASK(WCF_NOW) | WCF_MASK(WCF_MIXED) | WCF_MASK(WCF_URL))
+
+/**
+ * \ingroup SubWCRev
+ * Fills the revision range, the last committed revision and date, the
+ * URL and the author of SubStat with aggregate queries on the wc.db of
+ * the working copy, without crawling the working copy.
+ * Local modifications, lock information and externals are not looked at.
+ * Returns false if the working copy can not be answered this way (unknown
+ * format, local additions or deletions, ...); SubStat is then untouched
+ * and the caller has to crawl the working copy instead.
+ */
+bool WcDbGetRevisions(const char * path, SubWCRev_t * SubStat, apr_pool_t * pool);
+
+// Start value for HashBytes()
+#define HASH_INIT   14695981039346656037ULL
+
+/**
+ * \ingroup SubWCRev
+ * Adds len bytes at data to the 64 bit FNV-1a hash.
+ */
+void HashBytes(apr_uint64_t * hash, const void * data, size_t len);
+
+/**
+ * \ingroup SubWCRev
+ * Computes a cheap fingerprint of the working copy at path: the identity
+ * and timestamp of its wc.db plus the timestamps of all versioned
+ * directories. With bFiles, the timestamps and sizes of the versioned
+ * files are included too, which costs a stat per file. With bExternals,
+ * the externals checked out below path are included. Any change svn
+ * status could report changes the fingerprint, text modifications only
+ * with bFiles. Returns false if wc.db can not be read.
+ */
+bool WcDbFingerprint(const char * path, bool bExternals, bool bFiles, apr_uint64_t * fingerprint, apr_pool_t * pool);
+
+/**
+ * \ingroup SubWCRev
+ * A versioned file with the size and timestamp wc.db recorded for it when
+ * it was last known to be unmodified.
+ */
+typedef struct SubWcDbFile_t
+{
+    std::string Path;           // the working file
+    std::string Pristine;       // its pristine copy, empty if there is none
+    apr_int64_t Size;           // recorded size, -1 if none
+    apr_time_t ModTime;         // recorded timestamp, 0 if none
+} SubWcDbFile_t;
+
+/**
+ * \ingroup SubWCRev
+ * Lists the files below and including path which are in the working copy,
+ * as they are now (the highest op_depth), with one query on its wc.db.
+ * Returns false if wc.db can not be read.
+ */
+bool WcDbListFiles(const char * path, std::vector<SubWcDbFile_t> & files, apr_pool_t * pool);
+
+/**
+ * \ingroup SubWCRev
+ * Appends the wc.db of the working copy containing path to deps and,
+ * with bExternals, the wc.db of every external checked out below path:
+ * the files an update, commit, lock, ... shows up in. Editing a file
+ * does not touch wc.db; with bFiles the versioned files are appended as
+ * well. Returns false if path is in no working copy.
+ */
+bool WcDbDependencies(const char * path, bool bExternals, bool bFiles, std::vector<std::string> & deps,
+                      apr_pool_t * pool);